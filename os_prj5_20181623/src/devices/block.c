@@ -19,6 +19,7 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long request_cnt;     /* Number of driver requests. */
   };
 
 /* List of all block devices. */
@@ -123,6 +124,7 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
   check_sector (block, sector);
   block->ops->read (block->aux, sector, buffer);
   block->read_cnt++;
+  block->request_cnt++;
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -137,6 +139,60 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
   ASSERT (block->type != BLOCK_FOREIGN);
   block->ops->write (block->aux, sector, buffer);
   block->write_cnt++;
+  block->request_cnt++;
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Uses a single driver request if the driver supports
+   it, otherwise one per sector. */
+void
+block_read_sectors (struct block *block, block_sector_t sector, size_t cnt,
+                    void *buffer_)
+{
+  uint8_t *buffer = buffer_;
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  if (block->ops->read_sectors != NULL)
+    {
+      block->ops->read_sectors (block->aux, sector, cnt, buffer);
+      block->read_cnt += cnt;
+      block->request_cnt++;
+    }
+  else
+    for (i = 0; i < cnt; i++)
+      block_read (block, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Uses a single driver request if the driver supports it,
+   otherwise one per sector. */
+void
+block_write_sectors (struct block *block, block_sector_t sector, size_t cnt,
+                     const void *buffer_)
+{
+  const uint8_t *buffer = buffer_;
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  if (block->ops->write_sectors != NULL)
+    {
+      block->ops->write_sectors (block->aux, sector, cnt, buffer);
+      block->write_cnt += cnt;
+      block->request_cnt++;
+    }
+  else
+    for (i = 0; i < cnt; i++)
+      block_write (block, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -171,9 +227,9 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          printf ("%s (%s): %llu reads, %llu writes, %llu requests\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  block->read_cnt, block->write_cnt, block->request_cnt);
         }
     }
 }
@@ -200,6 +256,7 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->request_cnt = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
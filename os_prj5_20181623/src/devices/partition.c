@@ -317,8 +317,30 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Reads CNT sectors starting at SECTOR from partition P into
+   BUFFER. */
+static void
+partition_read_sectors (void *p_, block_sector_t sector, size_t cnt,
+                        void *buffer)
+{
+  struct partition *p = p_;
+  block_read_sectors (p->block, p->start + sector, cnt, buffer);
+}
+
+/* Writes CNT sectors starting at SECTOR to partition P from
+   BUFFER. */
+static void
+partition_write_sectors (void *p_, block_sector_t sector, size_t cnt,
+                         const void *buffer)
+{
+  struct partition *p = p_;
+  block_write_sectors (p->block, p->start + sector, cnt, buffer);
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    partition_read_sectors,
+    partition_write_sectors
   };
@@ -12,6 +12,7 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "filesys/filesys.h"
+#include "filesys/cache.h"
 #endif
 
 /* Keyboard control register port. */
@@ -132,6 +133,7 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  buffer_cache_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
@@ -0,0 +1,123 @@
+/* cachebench.c
+
+   Streams a large file while repeatedly looking up a set of
+   small files in a directory, to show whether the buffer cache
+   keeps the directory and inode sectors it needs for the lookups
+   while the stream passes through.  Run it under each
+   -cache-policy and compare the "hdX reads" count printed at
+   shutdown: a scan-resistant policy reads little more than the
+   large file itself.
+
+   Usage: cachebench [KB [FILES]] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+#define MAX_FILES 64
+
+/* Bytes streamed between two rounds of lookups. */
+#define STRIDE 4096
+
+static char buf[STRIDE];
+
+/* Creates FILE with SIZE bytes. */
+static bool
+make_file (const char *file, int size)
+{
+  int fd, ofs;
+
+  if (!create (file, 0) || (fd = open (file)) < 0)
+    return false;
+  memset (buf, 'x', sizeof buf);
+  for (ofs = 0; ofs < size; ofs += sizeof buf)
+    write (fd, buf, size - ofs < STRIDE ? size - ofs : STRIDE);
+  close (fd);
+  return true;
+}
+
+/* Opens and closes each of the first CNT small files. */
+static bool
+lookup_all (int cnt)
+{
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      char file[16];
+      int fd;
+
+      snprintf (file, sizeof file, "cbdir/f%d", i);
+      fd = open (file);
+      if (fd < 0)
+        return false;
+      close (fd);
+    }
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int kb = 256, files = 32;
+  int i, pass, rounds = 0;
+
+  if (argc > 1)
+    kb = atoi (argv[1]);
+  if (argc > 2)
+    files = atoi (argv[2]);
+  if (kb < 4 || files < 1 || files > MAX_FILES)
+    {
+      printf ("usage: cachebench [KB [FILES]], FILES at most %d\n",
+              MAX_FILES);
+      return EXIT_FAILURE;
+    }
+
+  if (!mkdir ("cbdir"))
+    {
+      printf ("cbdir: mkdir failed\n");
+      return EXIT_FAILURE;
+    }
+  for (i = 0; i < files; i++)
+    {
+      char file[16];
+      snprintf (file, sizeof file, "cbdir/f%d", i);
+      if (!make_file (file, 100))
+        {
+          printf ("%s: create failed\n", file);
+          return EXIT_FAILURE;
+        }
+    }
+  if (!make_file ("cbstream", kb * 1024))
+    {
+      printf ("cbstream: create failed\n");
+      return EXIT_FAILURE;
+    }
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      int fd = open ("cbstream");
+
+      if (fd < 0)
+        {
+          printf ("cbstream: open failed\n");
+          return EXIT_FAILURE;
+        }
+      while (read (fd, buf, sizeof buf) > 0)
+        {
+          if (!lookup_all (files))
+            {
+              printf ("cachebench: lookup failed\n");
+              close (fd);
+              return EXIT_FAILURE;
+            }
+          rounds++;
+        }
+      close (fd);
+    }
+
+  printf ("cachebench: streamed %d kB with %d lookups of %d files\n",
+          2 * kb, rounds, files);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,63 @@
+/* cachestat.c
+
+   Prints buffer cache statistics for the whole cache and for
+   each FILE named on the command line.
+
+   Usage: cachestat [FILE...] */
+
+#include <stdio.h>
+#include <syscall.h>
+
+static void
+print_class (const char *name, const struct cache_class_stat *c)
+{
+  uint32_t total = c->hits + c->misses;
+
+  printf ("  %-8s %u hits, %u misses (%u%% hit rate), %u evictions "
+          "(%u dirty), %u writebacks\n",
+          name, c->hits, c->misses,
+          total > 0 ? (unsigned) (100ULL * c->hits / total) : 0,
+          c->evictions, c->dirty_evictions, c->writebacks);
+  printf ("  %-8s %u prefetched (%u used), %lld ticks waiting on disk\n",
+          "", c->prefetches, c->prefetch_hits, c->io_ticks);
+}
+
+static void
+print_stat (const char *name, const struct cache_stat *stat)
+{
+  printf ("%s: %u entries, %u dirty\n", name, stat->size, stat->dirty);
+  print_class ("metadata", &stat->meta);
+  print_class ("data", &stat->data);
+}
+
+int
+main (int argc, char *argv[])
+{
+  struct cache_stat stat;
+  bool success = true;
+  int i;
+
+  if (!cachestat (-1, &stat))
+    {
+      printf ("cachestat: not supported\n");
+      return EXIT_FAILURE;
+    }
+  print_stat ("cache", &stat);
+
+  for (i = 1; i < argc; i++)
+    {
+      int fd = open (argv[i]);
+      if (fd < 0)
+        {
+          printf ("%s: open failed\n", argv[i]);
+          success = false;
+          continue;
+        }
+      if (cachestat (fd, &stat))
+        print_stat (argv[i], &stat);
+      else
+        printf ("%s: not in the cache yet\n", argv[i]);
+      close (fd);
+    }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
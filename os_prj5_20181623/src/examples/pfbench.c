@@ -0,0 +1,115 @@
+/* pfbench.c
+
+   Runs several processes that each stream their own file at the
+   same time, to show how well file system I/O from different
+   processes overlaps.  Compare the "Timer: N ticks" line printed
+   at shutdown between kernels.
+
+   Usage: pfbench [PROCS [KB]] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+#define MAX_PROCS 8
+
+static char buf[512];
+
+/* Reads all of FILE, twice, and checks its contents. */
+static int
+reader (const char *file)
+{
+  int pass;
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      int fd = open (file);
+      int ofs = 0;
+      int n;
+
+      if (fd < 0)
+        {
+          printf ("%s: open failed\n", file);
+          return EXIT_FAILURE;
+        }
+      while ((n = read (fd, buf, sizeof buf)) > 0)
+        {
+          int i;
+          for (i = 0; i < n; i++)
+            if (buf[i] != (char) (ofs + i))
+              {
+                printf ("%s: bad byte at offset %d\n", file, ofs + i);
+                close (fd);
+                return EXIT_FAILURE;
+              }
+          ofs += n;
+        }
+      close (fd);
+    }
+  return EXIT_SUCCESS;
+}
+
+/* Creates FILE with SIZE bytes of a known pattern. */
+static bool
+make_file (const char *file, int size)
+{
+  int fd, ofs;
+
+  if (!create (file, 0) || (fd = open (file)) < 0)
+    return false;
+  for (ofs = 0; ofs < size; ofs += sizeof buf)
+    {
+      int i;
+      for (i = 0; i < (int) sizeof buf; i++)
+        buf[i] = (char) (ofs + i);
+      write (fd, buf, sizeof buf);
+    }
+  close (fd);
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t pids[MAX_PROCS];
+  int procs = 4, kb = 64;
+  int i, status = EXIT_SUCCESS;
+
+  if (argc == 3 && !strcmp (argv[1], "-r"))
+    return reader (argv[2]);
+  if (argc > 1)
+    procs = atoi (argv[1]);
+  if (argc > 2)
+    kb = atoi (argv[2]);
+  if (procs < 1 || procs > MAX_PROCS || kb < 1)
+    {
+      printf ("usage: pfbench [PROCS [KB]], PROCS at most %d\n", MAX_PROCS);
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < procs; i++)
+    {
+      char file[16];
+      snprintf (file, sizeof file, "pfb%d", i);
+      if (!make_file (file, kb * 1024))
+        {
+          printf ("%s: create failed\n", file);
+          return EXIT_FAILURE;
+        }
+    }
+
+  for (i = 0; i < procs; i++)
+    {
+      char cmd[32];
+      snprintf (cmd, sizeof cmd, "pfbench -r pfb%d", i);
+      pids[i] = exec (cmd);
+    }
+  for (i = 0; i < procs; i++)
+    if (pids[i] == PID_ERROR || wait (pids[i]) != EXIT_SUCCESS)
+      status = EXIT_FAILURE;
+
+  printf ("pfbench: %d processes read %d kB each%s\n", procs, 2 * kb,
+          status == EXIT_SUCCESS ? "" : ", with errors");
+  return status;
+}
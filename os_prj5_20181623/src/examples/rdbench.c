@@ -0,0 +1,109 @@
+/* rdbench.c
+
+   Starts several processes that all read the same large file at
+   once, each printing a line every time it gets through another
+   quarter of it.  When readers can share the file, the lines of
+   different readers interleave and the run finishes in about the
+   time a single reader spends waiting for the disk; when reads
+   are serialized, each reader's lines come out in one block.
+   Compare the "Timer" ticks printed at shutdown for one reader
+   and for several.
+
+   Usage: rdbench [READERS [KB]] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+#define MAX_READERS 16
+
+/* Bytes moved by each read or write call. */
+#define CHUNK 4096
+
+static char buf[CHUNK];
+
+/* Reads FILE, SIZE bytes long, from start to end as reader ID. */
+static int
+read_file (const char *file, int id, int size)
+{
+  int fd = open (file);
+  int ofs = 0, quarter = 1;
+
+  if (fd < 0)
+    {
+      printf ("reader %d: %s: open failed\n", id, file);
+      return EXIT_FAILURE;
+    }
+  for (;;)
+    {
+      int n = read (fd, buf, sizeof buf);
+      if (n <= 0)
+        break;
+      ofs += n;
+      while (quarter <= 4 && ofs >= size / 4 * quarter)
+        printf ("reader %d: %d/4\n", id, quarter++);
+    }
+  close (fd);
+  if (ofs != size)
+    {
+      printf ("reader %d: read %d of %d bytes\n", id, ofs, size);
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t pids[MAX_READERS];
+  int readers = 4, kb = 256;
+  int i, fd, ofs, size, status = EXIT_SUCCESS;
+
+  /* A child started by the parent below. */
+  if (argc == 4 && !strcmp (argv[1], "-r"))
+    return read_file ("rdfile", atoi (argv[2]), atoi (argv[3]));
+
+  if (argc > 1)
+    readers = atoi (argv[1]);
+  if (argc > 2)
+    kb = atoi (argv[2]);
+  if (readers < 1 || readers > MAX_READERS || kb < 4)
+    {
+      printf ("usage: rdbench [READERS [KB]], READERS at most %d\n",
+              MAX_READERS);
+      return EXIT_FAILURE;
+    }
+
+  size = kb * 1024;
+  if (!create ("rdfile", 0) || (fd = open ("rdfile")) < 0)
+    {
+      printf ("rdfile: create failed\n");
+      return EXIT_FAILURE;
+    }
+  memset (buf, 'r', sizeof buf);
+  for (ofs = 0; ofs < size; ofs += sizeof buf)
+    write (fd, buf, size - ofs < CHUNK ? size - ofs : CHUNK);
+  close (fd);
+
+  for (i = 0; i < readers; i++)
+    {
+      char cmd[32];
+
+      snprintf (cmd, sizeof cmd, "rdbench -r %d %d", i, size);
+      pids[i] = exec (cmd);
+      if (pids[i] == PID_ERROR)
+        {
+          printf ("rdbench: exec failed\n");
+          readers = i;
+          status = EXIT_FAILURE;
+          break;
+        }
+    }
+  for (i = 0; i < readers; i++)
+    if (wait (pids[i]) != EXIT_SUCCESS)
+      status = EXIT_FAILURE;
+
+  printf ("rdbench: %d readers read %d kB each\n", readers, kb);
+  return status;
+}
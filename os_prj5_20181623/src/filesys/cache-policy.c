@@ -0,0 +1,473 @@
+#include "filesys/cache-policy.h"
+#include <debug.h>
+#include <hash.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "threads/malloc.h"
+
+/* Policies that can be chosen with -cache-policy. */
+static const struct cache_policy *policies[] =
+  {
+    &cache_policy_clock,
+    &cache_policy_2q,
+    &cache_policy_arc,
+    NULL,
+  };
+
+/* Returns the policy called NAME, or a null pointer if there is
+   none. */
+const struct cache_policy *
+cache_policy_find (const char *name)
+{
+  const struct cache_policy **p;
+
+  for (p = policies; *p != NULL; p++)
+    if (!strcmp ((*p)->name, name))
+      return *p;
+  return NULL;
+}
+
+/* Lists of resident entries. */
+
+static void
+list_init_empty (struct cache_policy_list *l)
+{
+  list_init (&l->list);
+  l->cnt = 0;
+}
+
+/* Adds E at the front of L. */
+static void
+push_front (struct cache_policy_list *l, struct buffer_cache_entry *e)
+{
+  list_push_front (&l->list, &e->policy_elem);
+  l->cnt++;
+  e->policy_list = l;
+}
+
+/* Takes E off whatever list it is on. */
+static void
+detach (struct buffer_cache_entry *e)
+{
+  ASSERT (e->policy_list != NULL);
+  list_remove (&e->policy_elem);
+  e->policy_list->cnt--;
+  e->policy_list = NULL;
+}
+
+/* Returns the evictable entry nearest to the back of L, or a
+   null pointer. */
+static struct buffer_cache_entry *
+scan_back (struct cache_policy_list *l, cache_evictable_func *evictable)
+{
+  struct list_elem *elem;
+
+  for (elem = list_rbegin (&l->list); elem != list_rend (&l->list);
+       elem = list_prev (elem))
+    {
+      struct buffer_cache_entry *e
+        = list_entry (elem, struct buffer_cache_entry, policy_elem);
+      if (evictable (e))
+        return e;
+    }
+  return NULL;
+}
+
+/* Ghost lists remember the sectors of recently evicted entries,
+   without their data, so that 2Q and ARC can tell a sector that
+   comes back soon from one that is seen for the first time. */
+
+struct ghost
+  {
+    block_sector_t sector;
+    struct ghost_list *list;
+    struct list_elem elem;
+    struct hash_elem hash_elem;
+  };
+
+struct ghost_list
+  {
+    struct list list;           /* Most recent at the front. */
+    size_t cnt;
+  };
+
+/* All ghosts, by sector. */
+static struct hash ghost_index;
+
+static unsigned
+ghost_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct ghost, hash_elem)->sector);
+}
+
+static bool
+ghost_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct ghost, hash_elem)->sector
+          < hash_entry (b, struct ghost, hash_elem)->sector);
+}
+
+/* Drops every ghost left by a previous initialization. */
+static void
+ghost_free (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct ghost, hash_elem));
+}
+
+static void
+ghost_init (void)
+{
+  static bool initialized;
+
+  if (initialized)
+    hash_clear (&ghost_index, ghost_free);
+  else if (!hash_init (&ghost_index, ghost_hash, ghost_less, NULL))
+    PANIC ("cache policy ghost index creation failed");
+  initialized = true;
+}
+
+static void
+ghost_list_init (struct ghost_list *gl)
+{
+  list_init (&gl->list);
+  gl->cnt = 0;
+}
+
+/* Returns the ghost of SECTOR, or a null pointer. */
+static struct ghost *
+ghost_find (block_sector_t sector)
+{
+  struct ghost key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&ghost_index, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct ghost, hash_elem) : NULL;
+}
+
+static void
+ghost_remove (struct ghost *g)
+{
+  hash_delete (&ghost_index, &g->hash_elem);
+  list_remove (&g->elem);
+  g->list->cnt--;
+  free (g);
+}
+
+/* Remembers SECTOR at the front of GL.  Losing a ghost only
+   costs accuracy, so allocation failure is ignored. */
+static void
+ghost_add (struct ghost_list *gl, block_sector_t sector)
+{
+  struct ghost *g = ghost_find (sector);
+
+  if (g != NULL)
+    ghost_remove (g);
+  g = malloc (sizeof *g);
+  if (g == NULL)
+    return;
+  g->sector = sector;
+  g->list = gl;
+  list_push_front (&gl->list, &g->elem);
+  gl->cnt++;
+  hash_insert (&ghost_index, &g->hash_elem);
+}
+
+/* Forgets the oldest ghosts in GL until at most MAX remain. */
+static void
+ghost_trim (struct ghost_list *gl, size_t max)
+{
+  while (gl->cnt > max)
+    ghost_remove (list_entry (list_back (&gl->list), struct ghost, elem));
+}
+
+/* CLOCK: the one-bit second-chance algorithm.  Resident entries
+   form a ring swept by a hand; an entry hit since the hand last
+   passed has its reference bit cleared and is skipped once. */
+
+static struct cache_policy_list clock_ring;
+static struct list_elem *clock_hand;
+
+static void
+clock_init (void)
+{
+  list_init_empty (&clock_ring);
+  clock_hand = list_end (&clock_ring.list);
+}
+
+static void
+clock_resize (size_t capacity UNUSED)
+{
+}
+
+/* New entries go just behind the hand, the last place it will
+   reach. */
+static void
+clock_insert (struct buffer_cache_entry *e)
+{
+  list_insert (clock_hand, &e->policy_elem);
+  clock_ring.cnt++;
+  e->policy_list = &clock_ring;
+  e->refer = true;
+}
+
+static void
+clock_touch (struct buffer_cache_entry *e)
+{
+  e->refer = true;
+}
+
+static void
+clock_remove (struct buffer_cache_entry *e)
+{
+  if (clock_hand == &e->policy_elem)
+    clock_hand = list_next (clock_hand);
+  detach (e);
+}
+
+static struct buffer_cache_entry *
+clock_victim (block_sector_t incoming UNUSED, cache_evictable_func *evictable)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * clock_ring.cnt; i++)
+    {
+      struct buffer_cache_entry *e;
+
+      if (clock_hand == list_end (&clock_ring.list))
+        clock_hand = list_begin (&clock_ring.list);
+      e = list_entry (clock_hand, struct buffer_cache_entry, policy_elem);
+      clock_hand = list_next (clock_hand);
+      if (!evictable (e))
+        continue;
+      if (!e->refer)
+        return e;
+      e->refer = false;
+    }
+  return NULL;
+}
+
+const struct cache_policy cache_policy_clock =
+  {
+    "clock",
+    clock_init,
+    clock_resize,
+    clock_insert,
+    clock_touch,
+    clock_remove,
+    clock_remove,
+    clock_victim,
+  };
+
+/* 2Q (Johnson and Shasha, VLDB 1994).  A sector seen for the
+   first time enters the FIFO A1in and, once evicted from it, is
+   remembered in the ghost list A1out.  Only a sector referenced
+   again while in A1out is promoted to the LRU list Am, so a
+   one-time scan passes through A1in without disturbing Am. */
+
+static struct cache_policy_list q_a1in, q_am;
+static struct ghost_list q_a1out;
+static size_t q_kin, q_kout;
+
+static void
+q_resize (size_t capacity)
+{
+  q_kin = capacity / 4 > 0 ? capacity / 4 : 1;
+  q_kout = capacity / 2;
+  ghost_trim (&q_a1out, q_kout);
+}
+
+static void
+q_init (void)
+{
+  ghost_init ();
+  list_init_empty (&q_a1in);
+  list_init_empty (&q_am);
+  ghost_list_init (&q_a1out);
+  q_resize (0);
+}
+
+static void
+q_insert (struct buffer_cache_entry *e)
+{
+  struct ghost *g = ghost_find (e->disk_sector);
+
+  if (g != NULL)
+    {
+      ghost_remove (g);
+      push_front (&q_am, e);
+    }
+  else
+    push_front (&q_a1in, e);
+}
+
+static void
+q_touch (struct buffer_cache_entry *e)
+{
+  if (e->policy_list == &q_am)
+    {
+      detach (e);
+      push_front (&q_am, e);
+    }
+}
+
+static void
+q_evict (struct buffer_cache_entry *e)
+{
+  if (e->policy_list == &q_a1in)
+    {
+      ghost_add (&q_a1out, e->disk_sector);
+      ghost_trim (&q_a1out, q_kout);
+    }
+  detach (e);
+}
+
+static struct buffer_cache_entry *
+q_victim (block_sector_t incoming UNUSED, cache_evictable_func *evictable)
+{
+  struct buffer_cache_entry *e = NULL;
+
+  if (q_a1in.cnt > q_kin)
+    e = scan_back (&q_a1in, evictable);
+  if (e == NULL)
+    e = scan_back (&q_am, evictable);
+  if (e == NULL)
+    e = scan_back (&q_a1in, evictable);
+  return e;
+}
+
+const struct cache_policy cache_policy_2q =
+  {
+    "2q",
+    q_init,
+    q_resize,
+    q_insert,
+    q_touch,
+    q_evict,
+    detach,
+    q_victim,
+  };
+
+/* ARC (Megiddo and Modha, FAST 2003).  T1 holds sectors seen
+   once recently and T2 sectors seen at least twice; B1 and B2
+   are their ghosts.  A miss that hits B1 means T1 was too small
+   and one that hits B2 means T2 was, so the target size P of T1
+   adapts between recency and frequency, while a scan can never
+   push more than P entries out of T2. */
+
+static struct cache_policy_list arc_t1, arc_t2;
+static struct ghost_list arc_b1, arc_b2;
+static size_t arc_c, arc_p;
+
+/* Keeps the directory within ARC's bounds: T1 and B1 together
+   hold at most C sectors, and all four lists at most 2C. */
+static void
+arc_trim (void)
+{
+  while (arc_t1.cnt + arc_b1.cnt > arc_c && arc_b1.cnt > 0)
+    ghost_trim (&arc_b1, arc_b1.cnt - 1);
+  while (arc_t1.cnt + arc_t2.cnt + arc_b1.cnt + arc_b2.cnt > 2 * arc_c
+         && arc_b1.cnt + arc_b2.cnt > 0)
+    {
+      if (arc_b2.cnt > 0)
+        ghost_trim (&arc_b2, arc_b2.cnt - 1);
+      else
+        ghost_trim (&arc_b1, arc_b1.cnt - 1);
+    }
+}
+
+static void
+arc_resize (size_t capacity)
+{
+  arc_c = capacity;
+  if (arc_p > arc_c)
+    arc_p = arc_c;
+  arc_trim ();
+}
+
+static void
+arc_init (void)
+{
+  ghost_init ();
+  list_init_empty (&arc_t1);
+  list_init_empty (&arc_t2);
+  ghost_list_init (&arc_b1);
+  ghost_list_init (&arc_b2);
+  arc_c = arc_p = 0;
+}
+
+static void
+arc_insert (struct buffer_cache_entry *e)
+{
+  struct ghost *g = ghost_find (e->disk_sector);
+
+  if (g != NULL && g->list == &arc_b1)
+    {
+      size_t delta = arc_b1.cnt >= arc_b2.cnt ? 1 : arc_b2.cnt / arc_b1.cnt;
+      arc_p = arc_p + delta < arc_c ? arc_p + delta : arc_c;
+      ghost_remove (g);
+      push_front (&arc_t2, e);
+    }
+  else if (g != NULL && g->list == &arc_b2)
+    {
+      size_t delta = arc_b2.cnt >= arc_b1.cnt ? 1 : arc_b1.cnt / arc_b2.cnt;
+      arc_p = arc_p > delta ? arc_p - delta : 0;
+      ghost_remove (g);
+      push_front (&arc_t2, e);
+    }
+  else
+    push_front (&arc_t1, e);
+  arc_trim ();
+}
+
+static void
+arc_touch (struct buffer_cache_entry *e)
+{
+  detach (e);
+  push_front (&arc_t2, e);
+}
+
+static void
+arc_evict (struct buffer_cache_entry *e)
+{
+  ghost_add (e->policy_list == &arc_t1 ? &arc_b1 : &arc_b2, e->disk_sector);
+  detach (e);
+  arc_trim ();
+}
+
+/* ARC's REPLACE: take from T1 when it is over its target P, or
+   exactly at it when the incoming sector is a B2 ghost. */
+static struct buffer_cache_entry *
+arc_victim (block_sector_t incoming, cache_evictable_func *evictable)
+{
+  struct ghost *g = ghost_find (incoming);
+  bool in_b2 = g != NULL && g->list == &arc_b2;
+  struct cache_policy_list *first, *second;
+  struct buffer_cache_entry *e;
+
+  if (arc_t1.cnt > 0 && (arc_t1.cnt > arc_p || (in_b2 && arc_t1.cnt == arc_p)))
+    {
+      first = &arc_t1;
+      second = &arc_t2;
+    }
+  else
+    {
+      first = &arc_t2;
+      second = &arc_t1;
+    }
+  e = scan_back (first, evictable);
+  return e != NULL ? e : scan_back (second, evictable);
+}
+
+const struct cache_policy cache_policy_arc =
+  {
+    "arc",
+    arc_init,
+    arc_resize,
+    arc_insert,
+    arc_touch,
+    arc_evict,
+    detach,
+    arc_victim,
+  };
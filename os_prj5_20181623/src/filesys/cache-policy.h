@@ -0,0 +1,61 @@
+#ifndef FILESYS_CACHE_POLICY_H
+#define FILESYS_CACHE_POLICY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <list.h>
+#include "devices/block.h"
+
+struct buffer_cache_entry;
+
+/* A list of cache entries kept by a replacement policy, most
+   recently added at the front. */
+struct cache_policy_list
+  {
+    struct list list;
+    size_t cnt;
+  };
+
+/* Returns true if the cache may evict E right now. */
+typedef bool cache_evictable_func (struct buffer_cache_entry *e);
+
+/* A buffer cache replacement policy.
+   The cache calls every hook with its lock held.  Entries that
+   hold a sector sit on one of the policy's lists, through their
+   policy_elem and policy_list members. */
+struct cache_policy
+  {
+    const char *name;
+
+    /* Prepares the policy for an empty cache. */
+    void (*init) (void);
+
+    /* The cache now has room for CAPACITY entries. */
+    void (*resize) (size_t capacity);
+
+    /* E was just loaded with a sector, on a miss. */
+    void (*insert) (struct buffer_cache_entry *e);
+
+    /* E was hit. */
+    void (*touch) (struct buffer_cache_entry *e);
+
+    /* E's sector is being replaced by another one. */
+    void (*evict) (struct buffer_cache_entry *e);
+
+    /* E is leaving the cache altogether. */
+    void (*remove) (struct buffer_cache_entry *e);
+
+    /* Picks an entry to make room for sector INCOMING among those
+       EVICTABLE accepts, or returns a null pointer if there is
+       none. */
+    struct buffer_cache_entry *(*victim) (block_sector_t incoming,
+                                          cache_evictable_func *evictable);
+  };
+
+extern const struct cache_policy cache_policy_clock;
+extern const struct cache_policy cache_policy_2q;
+extern const struct cache_policy cache_policy_arc;
+
+const struct cache_policy *cache_policy_find (const char *name);
+
+#endif /* filesys/cache-policy.h */
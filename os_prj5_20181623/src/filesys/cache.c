@@ -2,138 +2,1105 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <debug.h>
+#include <round.h>
+#include <inttypes.h>
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
 #include "filesys/inode.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 
 
 #define NUM_CACHE 64
+/* Sector buffers live in palloc'd pages, so the cache grows and
+   shrinks a page, i.e. this many entries, at a time. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+/* The cache never shrinks below this many entries. */
+#define MIN_CACHE (2 * SECTORS_PER_PAGE)
+/* Kernel pool watermarks, in pages: the cache gives a page back
+   when fewer than CACHE_FREE_LOW pages are free and takes one
+   more when over CACHE_FREE_HIGH pages are free. */
+#define CACHE_FREE_LOW 16
+#define CACHE_FREE_HIGH 64
+/* Memory pressure is checked once every this many misses. */
+#define CACHE_BALANCE_INTERVAL 32
 
-static struct buffer_cache_entry cache[NUM_CACHE];
+/* Entries [0, cache_cnt) are in use; the metadata for up to
+   cache_max entries is allocated up front and entry I's buffer
+   is in page I / SECTORS_PER_PAGE. */
+static struct buffer_cache_entry* cache;
+static size_t cache_cnt = NUM_CACHE;
+static size_t cache_max = 4 * NUM_CACHE;
+static unsigned cache_miss_cnt;
+/* Guards the index, the replacement policy, the cache size and every
+   entry's bookkeeping fields.  Never held across disk I/O: an
+   entry being filled is marked io_busy instead, so only threads
+   that want that very sector wait for it. */
 static struct lock buffer_cache_lock;
-int clock;
+static bool cache_terminated;
+/* Runs of sectors waiting to be prefetched by the read-ahead
+   thread, a ring buffer guarded by read_ahead_lock.  Requests
+   that find the queue full are dropped. */
+#define READ_AHEAD_QUEUE 64
+struct read_ahead_request{
+    block_sector_t sector;
+    size_t cnt;
+    enum cache_class type;
+    block_sector_t owner;
+};
+static struct read_ahead_request read_ahead_queue[READ_AHEAD_QUEUE];
+static unsigned read_ahead_head, read_ahead_tail;
+static struct lock read_ahead_lock;
+static struct condition read_ahead_cond;
+/* Write-behind: the flusher thread writes back every dirty
+   entry once per write_behind_interval ticks, and writers wake
+   it early once more than write_behind_ratio percent of the
+   entries are dirty. */
+static int64_t write_behind_interval = TIMER_FREQ;
+static unsigned write_behind_ratio = 50;
+static size_t dirty_cnt;
+static volatile bool write_behind_urgent;
+/* Maps a disk sector to the valid entry caching it.
+   Guarded by buffer_cache_lock. */
+static struct hash cache_index;
+/* Chooses which entry a miss replaces; see cache-policy.h.
+   Entries that hold no sector are kept on cache_free instead and
+   are always used first. */
+static const struct cache_policy* policy = &cache_policy_clock;
+static struct cache_policy_list cache_free;
+/* A data miss may not evict metadata while metadata fills no
+   more than meta_reserve percent of the cache, unless nothing
+   else can be evicted.  meta_cnt counts the valid metadata
+   entries; victim_strict tells buffer_cache_evictable() whether
+   the miss being served must spare them.  Guarded by
+   buffer_cache_lock. */
+static unsigned meta_reserve = 25;
+static size_t meta_cnt;
+static bool victim_strict;
+/* Statistics for the whole cache and, through owner_index, for
+   the sectors of each file.  A file has a record while an inode
+   for it is open or while it has dirty entries, and the record is
+   freed once neither holds.  Guarded by buffer_cache_lock. */
+enum cache_event{
+    CACHE_HIT,
+    CACHE_MISS,
+    CACHE_EVICTION,
+    CACHE_DIRTY_EVICTION,
+    CACHE_WRITEBACK,
+    CACHE_PREFETCH,
+    CACHE_PREFETCH_HIT
+};
+struct cache_owner{
+    block_sector_t owner;//inode sector
+    int open_cnt;//buffer_cache_open_owner() calls not yet closed
+    struct cache_stat stat;
+    struct list dirty;//its dirty entries, for fsync
+    struct hash_elem hash_elem;
+};
+static struct cache_stat cache_stat_total;
+static struct hash owner_index;
+/* Set once an owner record could not be allocated: some dirty
+   entries may then be on no owner's list, and flushing an owner
+   has to flush everything. */
+static bool owner_lost;
+/* Write-backs in progress, with buffer_cache_lock released.
+   writeback_done is signaled as each one finishes. */
+static unsigned writeback_cnt;
+static struct condition writeback_done;
 
 void buffer_cache_init();
 void buffer_cache_terminate();
-void buffer_cache_read(block_sector_t, void*, off_t, int, int);
-void buffer_cache_write(block_sector_t, void*, off_t, int, int);
-struct buffer_cache_entry* buffer_cache_lookup(block_sector_t);
-struct buffer_cache_entry* buffer_cache_select_victim();
-void buffer_cache_flush_entry(struct buffer_cache_entry*);
+bool buffer_cache_read(block_sector_t, void*, off_t, int, int, enum cache_class, block_sector_t);
+void buffer_cache_write(block_sector_t, void*, off_t, int, int, enum cache_class, block_sector_t);
 void buffer_cache_flush_all();
+static struct buffer_cache_entry* buffer_cache_lookup(block_sector_t);
+static struct buffer_cache_entry* buffer_cache_select_victim(block_sector_t, enum cache_class);
+static cache_evictable_func buffer_cache_evictable;
+static void buffer_cache_flush_entry(struct buffer_cache_entry*);
+static struct buffer_cache_entry* buffer_cache_acquire(block_sector_t, enum cache_class, block_sector_t, bool, bool*);
+static void buffer_cache_load_run(block_sector_t, struct buffer_cache_entry**, size_t);
+static void buffer_cache_flush_run(struct buffer_cache_entry**, size_t);
+static void buffer_cache_release(struct buffer_cache_entry*, bool);
+static hash_hash_func buffer_cache_hash;
+static hash_less_func buffer_cache_less;
+static void buffer_cache_assign(struct buffer_cache_entry*, block_sector_t);
+static void buffer_cache_set_class(struct buffer_cache_entry*, enum cache_class);
+static void buffer_cache_count(block_sector_t, enum cache_class, enum cache_event, int64_t);
+static struct cache_owner* buffer_cache_find_owner(block_sector_t, bool);
+static void buffer_cache_release_owner(struct cache_owner*);
+static hash_hash_func owner_hash;
+static hash_less_func owner_less;
+static void buffer_cache_balance(void);
+static bool buffer_cache_grow(void);
+static void buffer_cache_shrink(void);
+static thread_func buffer_cache_read_ahead_thread NO_RETURN;
+static thread_func buffer_cache_write_behind_thread NO_RETURN;
+static void buffer_cache_mark_dirty(struct buffer_cache_entry*);
+static void buffer_cache_mark_clean(struct buffer_cache_entry*);
+static void buffer_cache_set_owner(struct buffer_cache_entry*, block_sector_t);
+static void buffer_cache_flush_sorted(block_sector_t*, size_t);
+static void buffer_cache_writeback_end(void);
+static int compare_sectors(const void*, const void*, void*);
+
+/* Sets the number of cache entries to allocate at
+   buffer_cache_init() to INIT_CNT and lets the cache grow up to
+   MAX_CNT entries while memory is plentiful.  A count of 0
+   keeps the default.  Both are rounded up to whole pages. */
+void buffer_cache_configure(size_t init_cnt, size_t max_cnt)
+{
+    if(init_cnt != 0){
+        cache_cnt = ROUND_UP(init_cnt, SECTORS_PER_PAGE);
+        if(cache_cnt < MIN_CACHE)
+            cache_cnt = MIN_CACHE;
+        cache_max = 4 * cache_cnt;
+    }
+    if(max_cnt != 0)
+        cache_max = ROUND_UP(max_cnt, SECTORS_PER_PAGE);
+    if(cache_max < cache_cnt)
+        cache_max = cache_cnt;
+}
+
+/* Sets the write-behind period to INTERVAL timer ticks and the
+   share of dirty entries, in percent, that wakes the flusher
+   early to RATIO.  A value of 0 keeps the default. */
+void buffer_cache_configure_write_behind(int64_t interval, unsigned ratio)
+{
+    if(interval > 0)
+        write_behind_interval = interval;
+    if(ratio > 0 && ratio <= 100)
+        write_behind_ratio = ratio;
+}
+
+/* Selects the replacement policy called NAME ("clock", "2q" or
+   "arc").  Returns false if there is no such policy.  Must be
+   called before buffer_cache_init(). */
+bool buffer_cache_set_policy(const char* name)
+{
+    const struct cache_policy* p = cache_policy_find(name);
+
+    if(p == NULL)
+        return false;
+    policy = p;
+    return true;
+}
+
+/* Reserves PCT percent of the cache for metadata.  0 turns the
+   reservation off. */
+void buffer_cache_configure_meta(unsigned pct)
+{
+    if(pct <= 100)
+        meta_reserve = pct;
+}
 
 //proj5
 void buffer_cache_init()
 {
-    for(int i=0; i<NUM_CACHE; i++){
-        memset(cache+i, 0, sizeof(struct buffer_cache_entry));
+    size_t init_cnt = cache_cnt;
+
+    cache = calloc(cache_max, sizeof *cache);
+    if(cache == NULL)
+        PANIC("buffer cache allocation failed");
+    for(size_t i=0; i<cache_max; i++){
         lock_init(&cache[i].entry_lock);
+        cond_init(&cache[i].io_done);
     }
     lock_init(&buffer_cache_lock);
-    clock = 0;
+    if(hash_init(&cache_index, buffer_cache_hash, buffer_cache_less, NULL) == false)
+        PANIC("buffer cache index creation failed");
+    if(hash_init(&owner_index, owner_hash, owner_less, NULL) == false)
+        PANIC("buffer cache index creation failed");
+    list_init(&cache_free.list);
+    cache_free.cnt = 0;
+    meta_cnt = 0;
+    policy->init();
+    cache_cnt = 0;
+    while(cache_cnt < init_cnt)
+        if(buffer_cache_grow() == false)
+            PANIC("buffer cache allocation failed");
+    cache_terminated = false;
+
+    lock_init(&read_ahead_lock);
+    cond_init(&read_ahead_cond);
+    read_ahead_head = read_ahead_tail = 0;
+    thread_create("read-ahead", PRI_DEFAULT, buffer_cache_read_ahead_thread, NULL);
+    dirty_cnt = 0;
+    writeback_cnt = 0;
+    cond_init(&writeback_done);
+    thread_create("write-behind", PRI_DEFAULT, buffer_cache_write_behind_thread, NULL);
 }
 
 //proj5
 void buffer_cache_terminate()
 {
-    for(int i=0; i<NUM_CACHE; i++){
-        lock_acquire(&cache[i].entry_lock);
-        if(&cache[i].dirty == true)
-            buffer_cache_flush_entry(&cache[i]);
-        lock_release(&cache[i].entry_lock);
-    }
-    clock = -1;
+    buffer_cache_flush_all();
+    lock_acquire(&buffer_cache_lock);
+    cache_terminated = true;
+    lock_release(&buffer_cache_lock);
 }
 
-//proj5
-void buffer_cache_read(block_sector_t sector_index, void* buffer, off_t offset, int chunk_size, int sector_ofs)
+/* Writes back every dirty entry, in ascending sector order so
+   that the disk sees one sweep instead of scattered writes, and
+   waits until all of them are on disk.  Without memory to sort
+   in, it writes them back in cache order instead. */
+void buffer_cache_flush_all()
 {
-    struct buffer_cache_entry* target = buffer_cache_lookup(sector_index);
-    if(target == NULL){
-        target = buffer_cache_select_victim();
-        lock_acquire(&target->entry_lock);
-        if(target->dirty == true)
-            buffer_cache_flush_entry(target);
-        target->dirty = false;
-        target->valid = true;
-        target->refer = true;
-        target->disk_sector = sector_index;
-        block_read(fs_device, sector_index, target->buffer);
+    block_sector_t* sectors = malloc(cache_max * sizeof *sectors);
+    size_t cnt = 0;
+
+    lock_acquire(&buffer_cache_lock);
+    if(sectors != NULL){
+        for(size_t i=0; i<cache_cnt; i++)
+            if(cache[i].valid == true && cache[i].dirty == true)
+                sectors[cnt++] = cache[i].disk_sector;
+        buffer_cache_flush_sorted(sectors, cnt);
     }
     else{
-        lock_acquire(&target->entry_lock);
-        target->refer = true;
+        /* The lock is dropped during each write, so check each
+           entry only when its turn comes. */
+        for(size_t i=0; i<cache_cnt; i++)
+            if(cache[i].valid == true && cache[i].dirty == true && cache[i].io_busy == false)
+                buffer_cache_flush_entry(&cache[i]);
     }
-    memcpy(buffer+offset, target->buffer+sector_ofs, chunk_size);
-    lock_release(&target->entry_lock);
+    while(writeback_cnt > 0)
+        cond_wait(&writeback_done, &buffer_cache_lock);
     lock_release(&buffer_cache_lock);
+    free(sectors);
 }
 
+/* Writes back every dirty entry of the file whose inode is in
+   sector OWNER, its data and its inode and index blocks, in
+   ascending sector order, and waits until they are on disk. */
+void buffer_cache_flush_owner(block_sector_t owner)
+{
+    block_sector_t* sectors = malloc(cache_max * sizeof *sectors);
+    struct cache_owner* o;
+    size_t cnt = 0;
+
+    if(sectors == NULL || owner_lost == true){
+        free(sectors);
+        buffer_cache_flush_all();
+        return;
+    }
+    lock_acquire(&buffer_cache_lock);
+    o = buffer_cache_find_owner(owner, false);
+    if(o != NULL){
+        struct list_elem* e;
+        for(e = list_begin(&o->dirty); e != list_end(&o->dirty); e = list_next(e))
+            sectors[cnt++] = list_entry(e, struct buffer_cache_entry, dirty_elem)->disk_sector;
+    }
+    buffer_cache_flush_sorted(sectors, cnt);
+    /* A write-back that the flusher started earlier may still be
+       on its way to the disk. */
+    while(writeback_cnt > 0)
+        cond_wait(&writeback_done, &buffer_cache_lock);
+    lock_release(&buffer_cache_lock);
+    free(sectors);
+}
+
+/* Sorts the CNT sectors in SECTORS and writes back those still
+   cached and dirty, consecutive ones together.  Must hold
+   buffer_cache_lock. */
+static void buffer_cache_flush_sorted(block_sector_t* sectors, size_t cnt)
+{
+    sort(sectors, cnt, sizeof *sectors, compare_sectors, NULL);
+    for(size_t i=0; i<cnt; ){
+        struct buffer_cache_entry* run[BUFFER_CACHE_CLUSTER];
+        size_t n = 0;
+
+        /* Gather dirty entries for consecutive sectors, so that
+           each run goes to disk in one request. */
+        while(i < cnt && n < BUFFER_CACHE_CLUSTER){
+            struct buffer_cache_entry* target = buffer_cache_lookup(sectors[i]);
+            if(target == NULL || target->io_busy == true || target->dirty == false){
+                i++;
+                if(n > 0)
+                    break;
+                continue;
+            }
+            if(n > 0 && sectors[i] != run[0]->disk_sector + n)
+                break;
+            run[n++] = target;
+            i++;
+        }
+        if(n == 1)
+            buffer_cache_flush_entry(run[0]);
+        else if(n > 1)
+            buffer_cache_flush_run(run, n);
+    }
+}
+
+/* Brings the CNT sectors starting at FIRST, which are consecutive
+   on disk and hold TYPE for the file whose inode is in sector
+   OWNER, into the cache.  Each run of them that is not cached
+   yet is read with a single disk request.  The sectors count as
+   prefetched if PREFETCH, as misses otherwise; either way their
+   first use is not a second reference for the replacement
+   policy.  Stops early rather than wait for a dirty victim to be
+   written back.  Returns the number of sectors read. */
+size_t buffer_cache_fill(block_sector_t first, size_t cnt, enum cache_class type, block_sector_t owner, bool prefetch)
+{
+    struct buffer_cache_entry* run[BUFFER_CACHE_CLUSTER];
+    size_t loaded = 0;
+    size_t i = 0;
+
+    ASSERT(cnt <= BUFFER_CACHE_CLUSTER);
+    lock_acquire(&buffer_cache_lock);
+    while(i < cnt){
+        int64_t start = timer_ticks();
+        size_t n = 0;
+
+        while(i < cnt && buffer_cache_lookup(first + i) != NULL)
+            i++;
+        while(i + n < cnt && buffer_cache_lookup(first + i + n) == NULL){
+            struct buffer_cache_entry* target = buffer_cache_select_victim(first + i + n, type);
+            if(target == NULL || target->dirty == true)
+                break;
+            buffer_cache_assign(target, first + i + n);
+            buffer_cache_set_class(target, type);
+            buffer_cache_set_owner(target, owner);
+            target->pin_cnt = 1;
+            target->io_busy = true;
+            target->prefetched = prefetch;
+            target->clustered = !prefetch;
+            run[n++] = target;
+        }
+        if(n == 0)
+            break;
+        lock_release(&buffer_cache_lock);
+
+        buffer_cache_load_run(first + i, run, n);
+
+        lock_acquire(&buffer_cache_lock);
+        for(size_t j=0; j<n; j++){
+            buffer_cache_count(owner, type, prefetch ? CACHE_PREFETCH : CACHE_MISS, j == 0 ? timer_elapsed(start) : 0);
+            run[j]->io_busy = false;
+            run[j]->pin_cnt--;
+            cond_broadcast(&run[j]->io_done, &buffer_cache_lock);
+        }
+        loaded += n;
+        i += n;
+    }
+    lock_release(&buffer_cache_lock);
+    return loaded;
+}
+
+/* Reads the N consecutive sectors starting at FIRST into the
+   buffers of RUN, which are io_busy, with one disk request if a
+   bounce page is available. */
+static void buffer_cache_load_run(block_sector_t first, struct buffer_cache_entry** run, size_t n)
+{
+    uint8_t* bounce = n > 1 ? palloc_get_page(0) : NULL;
+
+    if(bounce == NULL){
+        for(size_t j=0; j<n; j++)
+            block_read(fs_device, first + j, run[j]->buffer);
+        return;
+    }
+    block_read_sectors(fs_device, first, n, bounce);
+    for(size_t j=0; j<n; j++)
+        memcpy(run[j]->buffer, bounce + j*BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+    palloc_free_page(bounce);
+}
+
+/* Writes back RUN, N dirty entries for consecutive sectors, with
+   one disk request.  Like buffer_cache_flush_entry(), but each
+   buffer is copied out under its entry_lock, one at a time, so
+   that the locks are never held together.  Must hold
+   buffer_cache_lock. */
+static void buffer_cache_flush_run(struct buffer_cache_entry** run, size_t n)
+{
+    uint8_t* bounce = palloc_get_page(0);
+    int64_t start;
+
+    if(bounce == NULL){
+        for(size_t j=0; j<n; j++)
+            if(run[j]->dirty == true)
+                buffer_cache_flush_entry(run[j]);
+        return;
+    }
+    for(size_t j=0; j<n; j++){
+        buffer_cache_mark_clean(run[j]);
+        run[j]->pin_cnt++;
+    }
+    writeback_cnt++;
+    lock_release(&buffer_cache_lock);
+
+    for(size_t j=0; j<n; j++){
+        lock_acquire(&run[j]->entry_lock);
+        memcpy(bounce + j*BLOCK_SECTOR_SIZE, run[j]->buffer, BLOCK_SECTOR_SIZE);
+        lock_release(&run[j]->entry_lock);
+    }
+    start = timer_ticks();
+    block_write_sectors(fs_device, run[0]->disk_sector, n, bounce);
+    palloc_free_page(bounce);
+
+    lock_acquire(&buffer_cache_lock);
+    for(size_t j=0; j<n; j++){
+        buffer_cache_count(run[j]->owner, run[j]->type, CACHE_WRITEBACK, j == 0 ? timer_elapsed(start) : 0);
+        run[j]->pin_cnt--;
+    }
+    buffer_cache_writeback_end();
+}
+
+/* Copies CHUNK_SIZE bytes at SECTOR_OFS in sector SECTOR_INDEX,
+   which holds TYPE for the file whose inode is in sector OWNER,
+   to BUFFER + OFFSET.  Returns true if the sector was already
+   cached, false if it had to be read from disk. */
 //proj5
-void buffer_cache_write(block_sector_t sector_index, void* buffer, off_t offset, int chunk_size, int sector_ofs)
+bool buffer_cache_read(block_sector_t sector_index, void* buffer, off_t offset, int chunk_size, int sector_ofs, enum cache_class type, block_sector_t owner)
 {
-    struct buffer_cache_entry* target = buffer_cache_lookup(sector_index);
-    if(target == NULL){
-        target = buffer_cache_select_victim();
-        lock_acquire(&target->entry_lock);
-        if(target->dirty == true)
-            buffer_cache_flush_entry(target);
-        target->dirty = true;
-        target->valid = true;
-        target->refer = true;
-        target->disk_sector = sector_index;
-        block_read(fs_device, sector_index, target->buffer);
+    bool hit;
+    struct buffer_cache_entry* target = buffer_cache_acquire(sector_index, type, owner, true, &hit);
+
+    memcpy(buffer+offset, target->buffer+sector_ofs, chunk_size);
+    buffer_cache_release(target, false);
+    return hit;
+}
+
+/* Copies CHUNK_SIZE bytes from BUFFER + OFFSET to SECTOR_OFS in
+   sector SECTOR_INDEX, which holds TYPE for the file whose inode
+   is in sector OWNER.  A write that covers the whole sector does
+   not read the old contents in first. */
+//proj5
+void buffer_cache_write(block_sector_t sector_index, void* buffer, off_t offset, int chunk_size, int sector_ofs, enum cache_class type, block_sector_t owner)
+{
+    bool whole = sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE;
+    struct buffer_cache_entry* target = buffer_cache_acquire(sector_index, type, owner, !whole, NULL);
+
+    memcpy(target->buffer+sector_ofs, buffer+offset, chunk_size);
+    buffer_cache_release(target, true);
+}
+
+/* Returns the entry caching SECTOR_INDEX, which holds TYPE for
+   the file whose inode is in sector OWNER, pinned against
+   eviction and locked, so that its buffer can be read or
+   modified in place.  Every call must be paired with
+   buffer_cache_put().  A thread that already holds an entry may
+   only get one for a sector further down the same file's
+   index (inode, then index blocks, then data), which keeps
+   entry locks deadlock-free. */
+struct buffer_cache_entry* buffer_cache_get(block_sector_t sector_index, enum cache_class type, block_sector_t owner)
+{
+    return buffer_cache_acquire(sector_index, type, owner, true, NULL);
+}
+
+/* Like buffer_cache_get(), but for a sector that was just
+   allocated: its old contents are never read from disk and the
+   returned buffer is zeroed. */
+struct buffer_cache_entry* buffer_cache_get_fresh(block_sector_t sector_index, enum cache_class type, block_sector_t owner)
+{
+    struct buffer_cache_entry* target = buffer_cache_acquire(sector_index, type, owner, false, NULL);
+    memset(target->buffer, 0, BLOCK_SECTOR_SIZE);
+    return target;
+}
+
+/* Releases TARGET, obtained from buffer_cache_get(), marking it
+   dirty if DIRTY. */
+void buffer_cache_put(struct buffer_cache_entry* target, bool dirty)
+{
+    buffer_cache_release(target, dirty);
+}
+
+/* Asks the read-ahead thread to bring the CNT consecutive sectors
+   starting at SECTOR_INDEX, which hold TYPE for the file whose
+   inode is in sector OWNER, into the cache in the background,
+   as with buffer_cache_fill().  Never blocks on disk I/O. */
+void buffer_cache_read_ahead(block_sector_t sector_index, size_t cnt, enum cache_class type, block_sector_t owner)
+{
+    lock_acquire(&read_ahead_lock);
+    if(read_ahead_head - read_ahead_tail < READ_AHEAD_QUEUE){
+        struct read_ahead_request* r = &read_ahead_queue[read_ahead_head++ % READ_AHEAD_QUEUE];
+        r->sector = sector_index;
+        r->cnt = cnt;
+        r->type = type;
+        r->owner = owner;
+        cond_signal(&read_ahead_cond, &read_ahead_lock);
     }
-    else{
+    lock_release(&read_ahead_lock);
+}
+
+/* Returns the entry for SECTOR_INDEX, pinned so that it cannot
+   be evicted and with its entry_lock held, until
+   buffer_cache_release().  On a miss the sector is read from
+   disk if FILL, otherwise the buffer is left for the caller to
+   overwrite.  Sets *HIT, if HIT is non-null, to whether the
+   sector was already cached.  Time spent waiting for the disk
+   is charged to TYPE and OWNER in the statistics.
+
+   The first use of a sector loaded by buffer_cache_fill() does
+   not count as a reference for the replacement policy, so that
+   streaming a file through read-ahead looks like one reference
+   per sector.
+
+   Disk I/O happens without buffer_cache_lock: a sector being
+   read in is marked io_busy and threads that want the same
+   sector wait on its io_done, while hits and misses on other
+   sectors go ahead. */
+static struct buffer_cache_entry* buffer_cache_acquire(block_sector_t sector_index, enum cache_class type, block_sector_t owner, bool fill, bool* hit)
+{
+    struct buffer_cache_entry* target;
+    int64_t start = timer_ticks();
+    bool waited = false;
+
+    if(hit != NULL)
+        *hit = true;
+    lock_acquire(&buffer_cache_lock);
+    for(;;){
+        target = buffer_cache_lookup(sector_index);
+        if(target != NULL){
+            if(target->io_busy == true){
+                cond_wait(&target->io_done, &buffer_cache_lock);
+                waited = true;
+                continue;
+            }
+            target->pin_cnt++;
+            buffer_cache_set_class(target, type);
+            buffer_cache_set_owner(target, owner);
+            if(target->prefetched == true)
+                buffer_cache_count(owner, type, CACHE_PREFETCH_HIT, 0);
+            if(target->clustered == false)
+                buffer_cache_count(owner, type, CACHE_HIT, waited ? timer_elapsed(start) : 0);
+            if(target->prefetched == false && target->clustered == false)
+                policy->touch(target);
+            target->prefetched = target->clustered = false;
+            lock_release(&buffer_cache_lock);
+            lock_acquire(&target->entry_lock);
+            return target;
+        }
+
+        if(hit != NULL)
+            *hit = false;
+        buffer_cache_balance();
+        target = buffer_cache_select_victim(sector_index, type);
+        if(target == NULL){
+            /* Every entry is pinned or busy; let them drain. */
+            lock_release(&buffer_cache_lock);
+            thread_yield();
+            lock_acquire(&buffer_cache_lock);
+            continue;
+        }
+        if(target->dirty == true){
+            /* The lock was dropped during the write, so another
+               thread may have brought the sector in meanwhile. */
+            buffer_cache_count(target->owner, target->type, CACHE_DIRTY_EVICTION, 0);
+            buffer_cache_flush_entry(target);
+            continue;
+        }
+
+        /* An unpinned entry has no holder, so taking its
+           entry_lock here cannot block. */
+        buffer_cache_assign(target, sector_index);
+        buffer_cache_set_class(target, type);
+        buffer_cache_set_owner(target, owner);
+        target->pin_cnt = 1;
+        target->prefetched = target->clustered = false;
         lock_acquire(&target->entry_lock);
-        target->refer = true;
-        target->dirty = true;
+        if(fill == false){
+            buffer_cache_count(owner, type, CACHE_MISS, timer_elapsed(start));
+            lock_release(&buffer_cache_lock);
+            return target;
+        }
+        target->io_busy = true;
+        lock_release(&buffer_cache_lock);
+
+        block_read(fs_device, sector_index, target->buffer);
+
+        lock_acquire(&buffer_cache_lock);
+        buffer_cache_count(owner, type, CACHE_MISS, timer_elapsed(start));
+        target->io_busy = false;
+        cond_broadcast(&target->io_done, &buffer_cache_lock);
+        lock_release(&buffer_cache_lock);
+        return target;
     }
-    memcpy(target->buffer+sector_ofs, buffer+offset, chunk_size);
+}
+
+/* Unlocks and unpins TARGET, marking it dirty first if DIRTY. */
+static void buffer_cache_release(struct buffer_cache_entry* target, bool dirty)
+{
     lock_release(&target->entry_lock);
+    lock_acquire(&buffer_cache_lock);
+    ASSERT(target->pin_cnt > 0);
+    if(dirty == true)
+        buffer_cache_mark_dirty(target);
+    target->pin_cnt--;
     lock_release(&buffer_cache_lock);
 }
 
+/* Returns the valid entry for TARGET, or a null pointer.
+   Must hold buffer_cache_lock. */
 //proj5
-struct buffer_cache_entry* buffer_cache_lookup(block_sector_t target)
+static struct buffer_cache_entry* buffer_cache_lookup(block_sector_t target)
 {
-    lock_acquire(&buffer_cache_lock);
-    for(int i = 0; i<NUM_CACHE; i++){
-        lock_acquire(&cache[i].entry_lock);
-        if(cache[i].valid == true && cache[i].disk_sector == target){
-            lock_release(&cache[i].entry_lock);
-            return &cache[i];
-        }
-        lock_release(&cache[i].entry_lock);
+    struct buffer_cache_entry key;
+    struct hash_elem* e;
+
+    key.disk_sector = target;
+    e = hash_find(&cache_index, &key.hash_elem);
+    return e != NULL ? hash_entry(e, struct buffer_cache_entry, hash_elem) : NULL;
+}
+
+/* Rebinds TARGET to SECTOR_INDEX and keeps cache_index in step:
+   the sector TARGET cached before is dropped from the index and
+   the new one is added, and the replacement policy is told.
+   Must hold buffer_cache_lock. */
+static void buffer_cache_assign(struct buffer_cache_entry* target, block_sector_t sector_index)
+{
+    if(target->valid == true){
+        hash_delete(&cache_index, &target->hash_elem);
+        policy->evict(target);
+        buffer_cache_count(target->owner, target->type, CACHE_EVICTION, 0);
+        buffer_cache_set_class(target, CACHE_DATA);
     }
-    return NULL;
+    else{
+        list_remove(&target->policy_elem);
+        cache_free.cnt--;
+    }
+    target->valid = true;
+    target->disk_sector = sector_index;
+    hash_insert(&cache_index, &target->hash_elem);
+    policy->insert(target);
 }
 
+/* Records that TARGET holds TYPE.  Must hold buffer_cache_lock. */
+static void buffer_cache_set_class(struct buffer_cache_entry* target, enum cache_class type)
+{
+    if(target->type == type)
+        return;
+    if(type == CACHE_META)
+        meta_cnt++;
+    else
+        meta_cnt--;
+    target->type = type;
+}
+
+static unsigned buffer_cache_hash(const struct hash_elem* e, void* aux UNUSED)
+{
+    return hash_int(hash_entry(e, struct buffer_cache_entry, hash_elem)->disk_sector);
+}
+
+static bool buffer_cache_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED)
+{
+    return hash_entry(a, struct buffer_cache_entry, hash_elem)->disk_sector
+        < hash_entry(b, struct buffer_cache_entry, hash_elem)->disk_sector;
+}
+
+/* Returns an entry to load SECTOR_INDEX, which holds TYPE, into:
+   an empty one if there is any, otherwise the one the
+   replacement policy picks.  A data miss first tries to spare
+   the metadata reserve.  Returns a null pointer if every entry
+   is pinned or busy.  Must hold buffer_cache_lock. */
 //proj5
-struct buffer_cache_entry* buffer_cache_select_victim()
-{
-    while(1){
-        lock_acquire(&cache[clock].entry_lock);
-        if(cache[clock].valid == false || cache[clock].refer == false){
-            struct buffer_cache_entry* temp = &cache[clock];
-            lock_release(&cache[clock].entry_lock);
-            clock = (clock + 1) % NUM_CACHE;
-            //if(++clock == NUM_CACHE)
-            //    clock = 0;
-            return temp;
-        }
-        cache[clock].refer = false;
-        lock_release(&cache[clock].entry_lock);
-        clock = (clock + 1) % NUM_CACHE;
-        //if(++clock == NUM_CACHE)
-        //    clock = 0;
+static struct buffer_cache_entry* buffer_cache_select_victim(block_sector_t sector_index, enum cache_class type)
+{
+    struct buffer_cache_entry* target;
+
+    if(list_empty(&cache_free.list) == false)
+        return list_entry(list_front(&cache_free.list), struct buffer_cache_entry, policy_elem);
+    victim_strict = type == CACHE_DATA && meta_cnt * 100 <= cache_cnt * meta_reserve;
+    target = policy->victim(sector_index, buffer_cache_evictable);
+    if(target == NULL && victim_strict == true){
+        victim_strict = false;
+        target = policy->victim(sector_index, buffer_cache_evictable);
     }
+    return target;
+}
+
+/* Returns true if TARGET may make room for the miss being served
+   by buffer_cache_select_victim(). */
+static bool buffer_cache_evictable(struct buffer_cache_entry* target)
+{
+    if(target->pin_cnt > 0 || target->io_busy == true)
+        return false;
+    return victim_strict == false || target->type == CACHE_DATA;
 }
 
+/* Writes TARGET back to disk.  buffer_cache_lock is released
+   during the write; TARGET stays pinned meanwhile, and its
+   entry_lock keeps writers from changing the buffer under the
+   disk.  It is marked clean before the write so that a write
+   racing with it dirties it again.  Must hold buffer_cache_lock. */
 //proj5
-void buffer_cache_flush_entry(struct buffer_cache_entry* target)
+static void buffer_cache_flush_entry(struct buffer_cache_entry* target)
 {
+    int64_t start;
+
+    buffer_cache_mark_clean(target);
+    target->pin_cnt++;
+    writeback_cnt++;
+    lock_release(&buffer_cache_lock);
+
+    lock_acquire(&target->entry_lock);
+    start = timer_ticks();
     block_write(fs_device, target->disk_sector, target->buffer);
-    memset(target->buffer, 0, sizeof(uint8_t)*BLOCK_SECTOR_SIZE);
+    lock_release(&target->entry_lock);
+
+    lock_acquire(&buffer_cache_lock);
+    buffer_cache_count(target->owner, target->type, CACHE_WRITEBACK, timer_elapsed(start));
+    target->pin_cnt--;
+    buffer_cache_writeback_end();
+}
+
+/* Notes that a write-back finished.  Must hold buffer_cache_lock. */
+static void buffer_cache_writeback_end(void)
+{
+    writeback_cnt--;
+    cond_broadcast(&writeback_done, &buffer_cache_lock);
+}
+
+/* Marks TARGET dirty and wakes the flusher if too much of the
+   cache is dirty.  Must hold buffer_cache_lock. */
+static void buffer_cache_mark_dirty(struct buffer_cache_entry* target)
+{
+    if(target->dirty == false){
+        struct cache_owner* o = buffer_cache_find_owner(target->owner, true);
+        target->dirty = true;
+        if(o != NULL){
+            list_push_back(&o->dirty, &target->dirty_elem);
+            target->dirty_listed = true;
+        }
+        else
+            owner_lost = true;
+        if(++dirty_cnt * 100 > cache_cnt * write_behind_ratio)
+            write_behind_urgent = true;
+    }
+}
+
+/* Marks TARGET clean, about to be written back.  Must hold
+   buffer_cache_lock. */
+static void buffer_cache_mark_clean(struct buffer_cache_entry* target)
+{
+    ASSERT(target->dirty == true);
     target->dirty = false;
-}
\ No newline at end of file
+    dirty_cnt--;
+    if(target->dirty_listed == true){
+        list_remove(&target->dirty_elem);
+        target->dirty_listed = false;
+        buffer_cache_release_owner(buffer_cache_find_owner(target->owner, false));
+    }
+}
+
+/* Records that TARGET belongs to the file whose inode is in
+   sector OWNER, moving it to that file's dirty list if it is
+   dirty.  Must hold buffer_cache_lock. */
+static void buffer_cache_set_owner(struct buffer_cache_entry* target, block_sector_t owner)
+{
+    if(target->owner == owner)
+        return;
+    if(target->dirty == true){
+        struct cache_owner* o = buffer_cache_find_owner(owner, true);
+        if(target->dirty_listed == true){
+            list_remove(&target->dirty_elem);
+            buffer_cache_release_owner(buffer_cache_find_owner(target->owner, false));
+        }
+        target->dirty_listed = o != NULL;
+        if(o != NULL)
+            list_push_back(&o->dirty, &target->dirty_elem);
+        else
+            owner_lost = true;
+    }
+    target->owner = owner;
+}
+
+/* Adjusts the cache size to memory pressure once every
+   CACHE_BALANCE_INTERVAL misses.  Must hold buffer_cache_lock. */
+static void buffer_cache_balance(void)
+{
+    size_t free_pages;
+
+    if(++cache_miss_cnt % CACHE_BALANCE_INTERVAL != 0)
+        return;
+    free_pages = palloc_free_cnt(0);
+    if(free_pages < CACHE_FREE_LOW && cache_cnt > MIN_CACHE)
+        buffer_cache_shrink();
+    else if(free_pages > CACHE_FREE_HIGH && cache_cnt < cache_max)
+        buffer_cache_grow();
+}
+
+/* Adds a page worth of empty entries to the cache.
+   Returns false if the cache is at its maximum size or no page
+   is available. */
+static bool buffer_cache_grow(void)
+{
+    uint8_t* page;
+
+    if(cache_cnt + SECTORS_PER_PAGE > cache_max)
+        return false;
+    page = palloc_get_page(0);
+    if(page == NULL)
+        return false;
+    for(size_t i=0; i<SECTORS_PER_PAGE; i++){
+        struct buffer_cache_entry* e = &cache[cache_cnt + i];
+        e->valid = false;
+        e->refer = false;
+        e->dirty = false;
+        e->io_busy = false;
+        e->prefetched = e->clustered = false;
+        e->dirty_listed = false;
+        e->type = CACHE_DATA;
+        e->pin_cnt = 0;
+        e->buffer = page + i*BLOCK_SECTOR_SIZE;
+        list_push_back(&cache_free.list, &e->policy_elem);
+        cache_free.cnt++;
+        e->policy_list = &cache_free;
+    }
+    cache_cnt += SECTORS_PER_PAGE;
+    policy->resize(cache_cnt);
+    return true;
+}
+
+/* Drops the last page worth of entries and returns that page to
+   the kernel pool, unless one of them is pinned, busy or dirty;
+   the flusher will have cleaned them by a later attempt.  Must
+   hold buffer_cache_lock. */
+static void buffer_cache_shrink(void)
+{
+    size_t first = cache_cnt - SECTORS_PER_PAGE;
+
+    for(size_t i=first; i<cache_cnt; i++){
+        struct buffer_cache_entry* e = &cache[i];
+        if(e->pin_cnt > 0 || e->io_busy == true || e->dirty == true)
+            return;
+    }
+    for(size_t i=first; i<cache_cnt; i++){
+        struct buffer_cache_entry* e = &cache[i];
+        if(e->valid == true){
+            hash_delete(&cache_index, &e->hash_elem);
+            policy->remove(e);
+            buffer_cache_set_class(e, CACHE_DATA);
+            e->valid = false;
+        }
+        else{
+            list_remove(&e->policy_elem);
+            cache_free.cnt--;
+        }
+        e->policy_list = NULL;
+    }
+    palloc_free_page(cache[first].buffer);
+    cache_cnt = first;
+    policy->resize(cache_cnt);
+}
+
+/* Drains the read-ahead queue, loading each sector that is not
+   cached yet. */
+static void buffer_cache_read_ahead_thread(void* aux UNUSED)
+{
+    for(;;){
+        struct read_ahead_request r;
+
+        lock_acquire(&read_ahead_lock);
+        while(read_ahead_head == read_ahead_tail)
+            cond_wait(&read_ahead_cond, &read_ahead_lock);
+        r = read_ahead_queue[read_ahead_tail++ % READ_AHEAD_QUEUE];
+        lock_release(&read_ahead_lock);
+
+        if(cache_terminated == false)
+            buffer_cache_fill(r.sector, r.cnt, r.type, r.owner, true);
+    }
+}
+
+/* Periodically writes back dirty entries so that evictions
+   almost always find clean victims. */
+static void buffer_cache_write_behind_thread(void* aux UNUSED)
+{
+    for(;;){
+        int64_t start = timer_ticks();
+        while(timer_elapsed(start) < write_behind_interval && write_behind_urgent == false)
+            timer_sleep(1);
+        write_behind_urgent = false;
+        if(cache_terminated == false){
+            /* Inodes and the free map go into the cache first, so
+               that nothing written back points at a sector the
+               free map on disk still calls free. */
+            inode_flush_all();
+            free_map_sync();
+            buffer_cache_flush_all();
+        }
+    }
+}
+
+/* Adds EVENT, which kept a thread waiting for TICKS, to the
+   counters for TYPE, overall and for OWNER.  Must hold
+   buffer_cache_lock. */
+static void buffer_cache_count(block_sector_t owner, enum cache_class type, enum cache_event event, int64_t ticks)
+{
+    struct cache_owner* o = buffer_cache_find_owner(owner, false);
+    struct cache_stat* stats[2] = {&cache_stat_total, o != NULL ? &o->stat : NULL};
+
+    for(int i=0; i<2; i++){
+        struct cache_class_stat* c;
+        if(stats[i] == NULL)
+            continue;
+        c = type == CACHE_META ? &stats[i]->meta : &stats[i]->data;
+        switch(event){
+            case CACHE_HIT: c->hits++; break;
+            case CACHE_MISS: c->misses++; break;
+            case CACHE_EVICTION: c->evictions++; break;
+            case CACHE_DIRTY_EVICTION: c->dirty_evictions++; break;
+            case CACHE_WRITEBACK: c->writebacks++; break;
+            case CACHE_PREFETCH: c->prefetches++; break;
+            case CACHE_PREFETCH_HIT: c->prefetch_hits++; break;
+        }
+        c->io_ticks += ticks;
+    }
+}
+
+/* Returns the statistics record for OWNER, creating it if CREATE
+   and there is none.  Returns a null pointer if there is none or
+   memory is short; a file then just goes uncounted.  Must hold
+   buffer_cache_lock. */
+static struct cache_owner* buffer_cache_find_owner(block_sector_t owner, bool create)
+{
+    struct cache_owner key;
+    struct cache_owner* o;
+    struct hash_elem* e;
+
+    key.owner = owner;
+    e = hash_find(&owner_index, &key.hash_elem);
+    if(e != NULL)
+        return hash_entry(e, struct cache_owner, hash_elem);
+    if(create == false || (o = calloc(1, sizeof *o)) == NULL)
+        return NULL;
+    o->owner = owner;
+    list_init(&o->dirty);
+    hash_insert(&owner_index, &o->hash_elem);
+    return o;
+}
+
+/* Frees O, if it is non-null, once no inode for its file is open
+   and it has no dirty entries left.  Must hold buffer_cache_lock. */
+static void buffer_cache_release_owner(struct cache_owner* o)
+{
+    if(o != NULL && o->open_cnt == 0 && list_empty(&o->dirty) == true){
+        hash_delete(&owner_index, &o->hash_elem);
+        free(o);
+    }
+}
+
+/* Starts keeping statistics for the file whose inode is in sector
+   OWNER, which is being opened, until the matching
+   buffer_cache_close_owner(). */
+void buffer_cache_open_owner(block_sector_t owner)
+{
+    struct cache_owner* o;
+
+    lock_acquire(&buffer_cache_lock);
+    o = buffer_cache_find_owner(owner, true);
+    if(o != NULL)
+        o->open_cnt++;
+    lock_release(&buffer_cache_lock);
+}
+
+/* Undoes buffer_cache_open_owner() for the file whose inode is in
+   sector OWNER, which was closed.  Its record goes once its dirty
+   entries are written back. */
+void buffer_cache_close_owner(block_sector_t owner)
+{
+    struct cache_owner* o;
+
+    lock_acquire(&buffer_cache_lock);
+    o = buffer_cache_find_owner(owner, false);
+    if(o != NULL && o->open_cnt > 0){
+        o->open_cnt--;
+        buffer_cache_release_owner(o);
+    }
+    lock_release(&buffer_cache_lock);
+}
+
+/* Copies the statistics for the whole cache to *STAT, which must
+   be kernel memory: it is written with buffer_cache_lock held. */
+void buffer_cache_stat(struct cache_stat* stat)
+{
+    lock_acquire(&buffer_cache_lock);
+    *stat = cache_stat_total;
+    stat->size = cache_cnt;
+    stat->dirty = dirty_cnt;
+    lock_release(&buffer_cache_lock);
+}
+
+/* Copies the statistics for the file whose inode is in sector
+   OWNER to *STAT, with the number of its entries and dirty
+   entries now in the cache.  Returns false if the cache has never
+   seen the file.  *STAT must be kernel memory, as for
+   buffer_cache_stat(). */
+bool buffer_cache_owner_stat(block_sector_t owner, struct cache_stat* stat)
+{
+    struct cache_owner* o;
+
+    lock_acquire(&buffer_cache_lock);
+    o = buffer_cache_find_owner(owner, false);
+    if(o != NULL){
+        *stat = o->stat;
+        stat->size = stat->dirty = 0;
+        for(size_t i=0; i<cache_cnt; i++)
+            if(cache[i].valid == true && cache[i].owner == owner){
+                stat->size++;
+                if(cache[i].dirty == true)
+                    stat->dirty++;
+            }
+    }
+    lock_release(&buffer_cache_lock);
+    return o != NULL;
+}
+
+/* Drops the statistics for the file whose inode is in sector
+   OWNER, which was deleted. */
+void buffer_cache_forget_owner(block_sector_t owner)
+{
+    struct cache_owner* o;
+
+    lock_acquire(&buffer_cache_lock);
+    o = buffer_cache_find_owner(owner, false);
+    if(o != NULL){
+        /* Its sectors are free, but may still be written back. */
+        while(list_empty(&o->dirty) == false){
+            struct list_elem* e = list_pop_front(&o->dirty);
+            list_entry(e, struct buffer_cache_entry, dirty_elem)->dirty_listed = false;
+        }
+        hash_delete(&owner_index, &o->hash_elem);
+    }
+    lock_release(&buffer_cache_lock);
+    free(o);
+}
+
+static void buffer_cache_print_class(const char* name, const struct cache_class_stat* c)
+{
+    printf("Cache %s: %"PRIu32" hits, %"PRIu32" misses, %"PRIu32" evictions (%"PRIu32" dirty), "
+           "%"PRIu32" writebacks, %"PRIu32" prefetched (%"PRIu32" used), %"PRId64" ticks on I/O\n",
+           name, c->hits, c->misses, c->evictions, c->dirty_evictions,
+           c->writebacks, c->prefetches, c->prefetch_hits, c->io_ticks);
+}
+
+/* Prints buffer cache statistics.  Called on the way to power
+   off, possibly from a kernel panic, so it takes no locks. */
+void buffer_cache_print_stats(void)
+{
+    if(cache == NULL)
+        return;
+    printf("Buffer cache: %zu entries, %zu dirty, policy %s\n",
+           cache_cnt, dirty_cnt, policy->name);
+    buffer_cache_print_class("metadata", &cache_stat_total.meta);
+    buffer_cache_print_class("data", &cache_stat_total.data);
+}
+
+static unsigned owner_hash(const struct hash_elem* e, void* aux UNUSED)
+{
+    return hash_int(hash_entry(e, struct cache_owner, hash_elem)->owner);
+}
+
+static bool owner_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED)
+{
+    return hash_entry(a, struct cache_owner, hash_elem)->owner
+        < hash_entry(b, struct cache_owner, hash_elem)->owner;
+}
+
+static int compare_sectors(const void* a_, const void* b_, void* aux UNUSED)
+{
+    const block_sector_t* a = a_;
+    const block_sector_t* b = b_;
+    return *a < *b ? -1 : *a > *b;
+}
@@ -1,24 +1,69 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include "devices/block.h"
+#include <hash.h>
+#include <cachestat.h>
 #include "threads/synch.h"
 #include "filesys/inode.h"
+#include "filesys/cache-policy.h"
+
 
+/* What a cached sector holds.  Metadata (inodes, index blocks,
+   directories and the free map) gets a reserved share of the
+   cache that file data cannot evict. */
+enum cache_class{
+    CACHE_DATA,
+    CACHE_META
+};
+
+/* Most sectors that buffer_cache_fill() reads with one disk
+   request. */
+#define BUFFER_CACHE_CLUSTER 8
 
 struct buffer_cache_entry{
     bool valid;
     bool refer;
     bool dirty;
+    bool io_busy;//being read in from disk
+    bool prefetched;//brought in by read-ahead, not used yet
+    bool clustered;//brought in by a clustered miss, not used yet
+    int pin_cnt;//users that keep it from being evicted
+    enum cache_class type;//class of the last request for it
+    block_sector_t owner;//inode sector of the file it belongs to
+    bool dirty_listed;//on its owner's dirty list
+    struct list_elem dirty_elem;//owner's dirty list
     block_sector_t disk_sector;
-    uint8_t buffer[BLOCK_SECTOR_SIZE];//512*1B
-    struct lock entry_lock;
+    uint8_t* buffer;//512*1B, inside a palloc'd page
+    struct lock entry_lock;//serializes access to buffer
+    struct condition io_done;//signaled when io_busy clears
+    struct hash_elem hash_elem;//sector index
+    struct list_elem policy_elem;//replacement policy or free list
+    struct cache_policy_list* policy_list;//list policy_elem is on
 };
 
+void buffer_cache_configure(size_t, size_t);
+void buffer_cache_configure_write_behind(int64_t, unsigned);
+bool buffer_cache_set_policy(const char*);
+void buffer_cache_configure_meta(unsigned);
 void buffer_cache_init();
 void buffer_cache_terminate();
-void buffer_cache_read(block_sector_t, void*, off_t, int, int);
-void buffer_cache_write(block_sector_t, void*, off_t, int, int);
-struct buffer_cache_entry* buffer_cache_lookup(block_sector_t);
-struct buffer_cache_entry* buffer_cache_select_victim();
-void buffer_cache_flush_entry(struct buffer_cache_entry*);
-void buffer_cache_flush_all();
\ No newline at end of file
+bool buffer_cache_read(block_sector_t, void*, off_t, int, int, enum cache_class, block_sector_t);
+void buffer_cache_write(block_sector_t, void*, off_t, int, int, enum cache_class, block_sector_t);
+struct buffer_cache_entry* buffer_cache_get(block_sector_t, enum cache_class, block_sector_t);
+struct buffer_cache_entry* buffer_cache_get_fresh(block_sector_t, enum cache_class, block_sector_t);
+void buffer_cache_put(struct buffer_cache_entry*, bool);
+size_t buffer_cache_fill(block_sector_t, size_t, enum cache_class, block_sector_t, bool);
+void buffer_cache_read_ahead(block_sector_t, size_t, enum cache_class, block_sector_t);
+void buffer_cache_flush_all();
+void buffer_cache_flush_owner(block_sector_t);
+void buffer_cache_stat(struct cache_stat*);
+bool buffer_cache_owner_stat(block_sector_t, struct cache_stat*);
+void buffer_cache_open_owner(block_sector_t);
+void buffer_cache_close_owner(block_sector_t);
+void buffer_cache_forget_owner(block_sector_t);
+void buffer_cache_print_stats(void);
+
+#endif /* filesys/cache.h */
@@ -0,0 +1,166 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Remembers what looking up a name in a directory found: the
+   sector of the named inode, or DCACHE_NEGATIVE if there was no
+   such name.  Directory code must keep it in step by calling
+   dcache_insert() whenever it adds or removes a name, with
+   DCACHE_NEGATIVE for a removed one, and dcache_forget_dir() once
+   a directory's sector is freed. */
+
+/* Most names the cache holds; the least recently used go first. */
+#define DCACHE_SIZE 256
+
+struct dcache_entry
+  {
+    block_sector_t dir;                 /* Sector of the directory. */
+    char name[NAME_MAX + 1];            /* Name looked up in DIR. */
+    block_sector_t sector;              /* What it names, or
+                                           DCACHE_NEGATIVE. */
+    struct hash_elem hash_elem;         /* In INDEX. */
+    struct list_elem lru_elem;          /* In LRU, most recent first. */
+  };
+
+static struct hash index;
+static struct list lru;
+static size_t entry_cnt;
+static struct lock dcache_lock;
+
+static unsigned
+dcache_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct dcache_entry *e = hash_entry (e_, struct dcache_entry,
+                                             hash_elem);
+  return hash_string (e->name) ^ hash_int (e->dir);
+}
+
+static bool
+dcache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dcache_entry *a = hash_entry (a_, struct dcache_entry,
+                                             hash_elem);
+  const struct dcache_entry *b = hash_entry (b_, struct dcache_entry,
+                                             hash_elem);
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  hash_init (&index, dcache_hash, dcache_less, NULL);
+  list_init (&lru);
+  entry_cnt = 0;
+  lock_init (&dcache_lock);
+}
+
+/* Returns the entry for NAME in DIR, or a null pointer.
+   dcache_lock must be held. */
+static struct dcache_entry *
+find (block_sector_t dir, const char *name)
+{
+  struct dcache_entry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&index, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dcache_entry, hash_elem) : NULL;
+}
+
+/* Drops entry E.  dcache_lock must be held. */
+static void
+drop (struct dcache_entry *e)
+{
+  hash_delete (&index, &e->hash_elem);
+  list_remove (&e->lru_elem);
+  entry_cnt--;
+  free (e);
+}
+
+/* Looks up NAME in directory DIR in the cache.  If it is there,
+   stores the sector it names, or DCACHE_NEGATIVE if DIR has no
+   such name, into *SECTOR and returns true.  Otherwise returns
+   false. */
+bool
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sector)
+{
+  struct dcache_entry *e;
+
+  lock_acquire (&dcache_lock);
+  e = find (dir, name);
+  if (e != NULL)
+    {
+      *sector = e->sector;
+      list_remove (&e->lru_elem);
+      list_push_front (&lru, &e->lru_elem);
+    }
+  lock_release (&dcache_lock);
+  return e != NULL;
+}
+
+/* Records that NAME in directory DIR names SECTOR, or nothing if
+   SECTOR is DCACHE_NEGATIVE. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector)
+{
+  struct dcache_entry *e;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+  lock_acquire (&dcache_lock);
+  e = find (dir, name);
+  if (e != NULL)
+    {
+      e->sector = sector;
+      list_remove (&e->lru_elem);
+      list_push_front (&lru, &e->lru_elem);
+    }
+  else
+    {
+      if (entry_cnt >= DCACHE_SIZE)
+        drop (list_entry (list_back (&lru), struct dcache_entry, lru_elem));
+      e = malloc (sizeof *e);
+      if (e != NULL)
+        {
+          e->dir = dir;
+          strlcpy (e->name, name, sizeof e->name);
+          e->sector = sector;
+          hash_insert (&index, &e->hash_elem);
+          list_push_front (&lru, &e->lru_elem);
+          entry_cnt++;
+        }
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every name in directory DIR, whose sector is being
+   freed and may come back as another directory. */
+void
+dcache_forget_dir (block_sector_t dir)
+{
+  struct list_elem *e, *next;
+
+  lock_acquire (&dcache_lock);
+  for (e = list_begin (&lru); e != list_end (&lru); e = next)
+    {
+      struct dcache_entry *d = list_entry (e, struct dcache_entry, lru_elem);
+      next = list_next (e);
+      if (d->dir == dir)
+        drop (d);
+    }
+  lock_release (&dcache_lock);
+}
@@ -1,10 +1,14 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 
 /* A directory. */
@@ -22,6 +26,23 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* A directory is either linear, an array of entries searched in
+   order, or hashed.  A hashed directory starts with a header
+   entry, never in use, whose name is DIR_HASH_NAME and whose
+   INODE_SECTOR is the number of buckets, a power of 2.  The
+   buckets of DIR_BUCKET_ENTRIES entries each follow, and a name
+   is only ever stored in the bucket its hash selects.  Names
+   cannot contain '/', so no real entry looks like the header. */
+#define DIR_HASH_NAME "/hashed"
+#define DIR_BUCKET_ENTRIES 16
+
+/* A linear directory with no free slot left and at least this
+   many entries is converted to the hashed format. */
+#define DIR_HASH_THRESHOLD 64
+
+/* Most buckets a hashed directory may have. */
+#define DIR_MAX_BUCKETS 8192
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -85,6 +106,261 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Returns the number of buckets of DIR if it is hashed, or 0 if
+   it is linear. */
+static size_t
+bucket_cnt (const struct dir *dir)
+{
+  struct dir_entry e;
+
+  if (inode_read_at (dir->inode, &e, sizeof e, 0) != sizeof e
+      || e.in_use || strcmp (e.name, DIR_HASH_NAME))
+    return 0;
+  return e.inode_sector;
+}
+
+/* Returns the byte offset of bucket BUCKET in a hashed
+   directory. */
+static off_t
+bucket_ofs (size_t bucket)
+{
+  return (1 + bucket * DIR_BUCKET_ENTRIES) * sizeof (struct dir_entry);
+}
+
+/* Returns the bucket for NAME among BUCKET_CNT buckets. */
+static size_t
+name_bucket (const char *name, size_t bucket_cnt)
+{
+  return hash_string (name) & (bucket_cnt - 1);
+}
+
+/* Reads bucket BUCKET of hashed DIR into ENTRIES. */
+static bool
+read_bucket (const struct dir *dir, size_t bucket,
+             struct dir_entry entries[DIR_BUCKET_ENTRIES])
+{
+  off_t size = DIR_BUCKET_ENTRIES * sizeof *entries;
+  return inode_read_at (dir->inode, entries, size, bucket_ofs (bucket)) == size;
+}
+
+/* Writes ENTRIES as bucket BUCKET of hashed DIR. */
+static bool
+write_bucket (struct dir *dir, size_t bucket,
+              const struct dir_entry entries[DIR_BUCKET_ENTRIES])
+{
+  off_t size = DIR_BUCKET_ENTRIES * sizeof *entries;
+  return inode_write_at (dir->inode, entries, size, bucket_ofs (bucket)) == size;
+}
+
+/* Writes the header of hashed DIR, which has BUCKET_CNT
+   buckets. */
+static bool
+write_header (struct dir *dir, size_t bucket_cnt)
+{
+  struct dir_entry e;
+
+  memset (&e, 0, sizeof e);
+  e.inode_sector = bucket_cnt;
+  strlcpy (e.name, DIR_HASH_NAME, sizeof e.name);
+  e.in_use = false;
+  return inode_write_at (dir->inode, &e, sizeof e, 0) == sizeof e;
+}
+
+/* Doubles the number of buckets of hashed DIR from BUCKET_CNT,
+   moving the entries of each bucket B that now hash to bucket
+   B + BUCKET_CNT there.
+
+   The new buckets are written, which is what may need more disk
+   space, before anything else changes.  If that fails, the ones
+   already written are emptied again and DIR keeps BUCKET_CNT
+   buckets.  Only after the header counts the new buckets are the
+   moved entries cleared from the old ones. */
+static bool
+split_buckets (struct dir *dir, size_t bucket_cnt)
+{
+  static const struct dir_entry empty[DIR_BUCKET_ENTRIES];
+  struct dir_entry entries[DIR_BUCKET_ENTRIES];
+  struct dir_entry moved[DIR_BUCKET_ENTRIES];
+  size_t b, i;
+
+  if (bucket_cnt * 2 > DIR_MAX_BUCKETS)
+    return false;
+  for (b = 0; b < bucket_cnt; b++)
+    {
+      bool ok = read_bucket (dir, b, entries);
+
+      memset (moved, 0, sizeof moved);
+      for (i = 0; ok && i < DIR_BUCKET_ENTRIES; i++)
+        if (entries[i].in_use
+            && name_bucket (entries[i].name, bucket_cnt * 2) != b)
+          moved[i] = entries[i];
+      if (!ok || !write_bucket (dir, b + bucket_cnt, moved))
+        goto undo;
+    }
+  if (!write_header (dir, bucket_cnt * 2))
+    {
+      b = bucket_cnt - 1;
+      goto undo;
+    }
+  for (b = 0; b < bucket_cnt; b++)
+    {
+      if (!read_bucket (dir, b, entries))
+        return false;
+      for (i = 0; i < DIR_BUCKET_ENTRIES; i++)
+        if (entries[i].in_use
+            && name_bucket (entries[i].name, bucket_cnt * 2) != b)
+          entries[i].in_use = false;
+      if (!write_bucket (dir, b, entries))
+        return false;
+    }
+  return true;
+
+ undo:
+  /* A short write leaves the rest of its bucket a hole, which
+     reads as empty, so this clears whatever was written. */
+  do
+    write_bucket (dir, b + bucket_cnt, empty);
+  while (b-- > 0);
+  return false;
+}
+
+/* Stores E in the bucket of hashed DIR, which has BUCKET_CNT
+   buckets, that its name hashes to, splitting the buckets while
+   that one is full. */
+static bool
+hashed_add (struct dir *dir, size_t bucket_cnt, const struct dir_entry *e)
+{
+  struct dir_entry entries[DIR_BUCKET_ENTRIES];
+
+  for (;;)
+    {
+      size_t b = name_bucket (e->name, bucket_cnt);
+      size_t i;
+
+      if (!read_bucket (dir, b, entries))
+        return false;
+      for (i = 0; i < DIR_BUCKET_ENTRIES; i++)
+        if (!entries[i].in_use)
+          return inode_write_at (dir->inode, e, sizeof *e,
+                                 bucket_ofs (b) + i * sizeof *e) == sizeof *e;
+      if (!split_buckets (dir, bucket_cnt))
+        return false;
+      bucket_cnt *= 2;
+    }
+}
+
+/* Fills TABLE, BUCKET_CNT buckets of DIR_BUCKET_ENTRIES entries,
+   with the entries in use among the CNT in OLD, each in the bucket
+   its name hashes to.  Returns false if a bucket overflows. */
+static bool
+fill_buckets (struct dir_entry *table, size_t bucket_cnt,
+              const struct dir_entry *old, size_t cnt)
+{
+  size_t i, j;
+
+  memset (table, 0, bucket_cnt * DIR_BUCKET_ENTRIES * sizeof *table);
+  for (i = 0; i < cnt; i++)
+    if (old[i].in_use)
+      {
+        struct dir_entry *bucket
+          = table + name_bucket (old[i].name, bucket_cnt) * DIR_BUCKET_ENTRIES;
+        for (j = 0; j < DIR_BUCKET_ENTRIES && bucket[j].in_use; j++)
+          continue;
+        if (j == DIR_BUCKET_ENTRIES)
+          return false;
+        bucket[j] = old[i];
+      }
+  return true;
+}
+
+/* Converts linear DIR, which has no free slot, to the hashed
+   format, with buckets for about twice as many entries as it
+   has.  Returns the number of buckets, or 0 on failure.
+
+   The buckets are laid out in memory and written before the
+   header, which is what makes DIR hashed, so DIR switches formats
+   with the single write of the header.  If writing the buckets
+   fails part way, what was written is put back the way it was and
+   DIR stays linear. */
+static size_t
+convert_to_hashed (struct dir *dir)
+{
+  off_t length = inode_length (dir->inode);
+  size_t cnt = length / sizeof (struct dir_entry);
+  struct dir_entry *old, *table = NULL;
+  off_t table_size, written;
+  size_t buckets = 1;
+  bool success = false;
+
+  old = malloc (cnt * sizeof *old);
+  if (old == NULL)
+    return 0;
+  if (inode_read_at (dir->inode, old, cnt * sizeof *old, 0)
+      != (off_t) (cnt * sizeof *old))
+    goto done;
+  while (buckets * DIR_BUCKET_ENTRIES < 2 * cnt && buckets < DIR_MAX_BUCKETS)
+    buckets *= 2;
+
+  /* Lay the buckets out, doubling them while one overflows. */
+  for (;;)
+    {
+      free (table);
+      table = malloc (buckets * DIR_BUCKET_ENTRIES * sizeof *table);
+      if (table == NULL)
+        goto done;
+      if (fill_buckets (table, buckets, old, cnt))
+        break;
+      if (buckets * 2 > DIR_MAX_BUCKETS)
+        goto done;
+      buckets *= 2;
+    }
+
+  table_size = buckets * DIR_BUCKET_ENTRIES * sizeof *table;
+  written = inode_write_at (dir->inode, table, table_size, bucket_ofs (0));
+  if (written == table_size && write_header (dir, buckets))
+    success = true;
+  else
+    {
+      /* The sectors written to are allocated now, so putting back
+         the old entries, and empty ones past them, cannot run out
+         of space. */
+      off_t restore = bucket_ofs (0) + written < length
+                      ? written : length - bucket_ofs (0);
+      memset (table, 0, written);
+      memcpy (table, old + 1, restore);
+      inode_write_at (dir->inode, table, written, bucket_ofs (0));
+    }
+
+ done:
+  free (table);
+  free (old);
+  return success ? buckets : 0;
+}
+
+/* Searches hashed DIR, which has BUCKET_CNT buckets, for NAME,
+   as lookup() does, reading only the bucket NAME hashes to. */
+static bool
+hashed_lookup (const struct dir *dir, size_t bucket_cnt, const char *name,
+               struct dir_entry *ep, off_t *ofsp)
+{
+  struct dir_entry entries[DIR_BUCKET_ENTRIES];
+  size_t b = name_bucket (name, bucket_cnt);
+  size_t i;
+
+  if (!read_bucket (dir, b, entries))
+    return false;
+  for (i = 0; i < DIR_BUCKET_ENTRIES; i++)
+    if (entries[i].in_use && !strcmp (name, entries[i].name))
+      {
+        if (ep != NULL)
+          *ep = entries[i];
+        if (ofsp != NULL)
+          *ofsp = bucket_ofs (b) + i * sizeof entries[i];
+        return true;
+      }
+  return false;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -94,42 +370,99 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e;
+  struct buffer_cache_entry *block = NULL;
+  off_t block_ofs = 0;
+  off_t length;
   size_t ofs;
+  size_t buckets;
+  bool found = false;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  buckets = bucket_cnt (dir);
+  if (buckets > 0)
+    return hashed_lookup (dir, buckets, name, ep, ofsp);
+
+  /* Compare names in place in the buffer cache, a sector at a
+     time.  An entry that straddles two sectors is copied out. */
+  length = inode_length (dir->inode);
+  for (ofs = 0; ofs + sizeof (struct dir_entry) <= (size_t) length && !found;
+       ofs += sizeof (struct dir_entry)) 
+    {
+      size_t sector_ofs = ofs % BLOCK_SECTOR_SIZE;
+      const struct dir_entry *p;
+      struct dir_entry e;
+
+      if (sector_ofs + sizeof e > BLOCK_SECTOR_SIZE)
+        {
+          /* inode_read_at() must not find the sector held. */
+          if (block != NULL)
+            buffer_cache_put (block, false);
+          block = NULL;
+          if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+            break;
+          p = &e;
+        }
+      else
+        {
+          if (block == NULL || ofs - sector_ofs != (size_t) block_ofs)
+            {
+              if (block != NULL)
+                buffer_cache_put (block, false);
+              block_ofs = ofs - sector_ofs;
+              block = inode_get_block (dir->inode, ofs);
+              if (block == NULL)
+                continue;           /* A hole: no entries in use. */
+            }
+          p = (const struct dir_entry *) (block->buffer + sector_ofs);
+        }
+
+      if (p->in_use && !strcmp (name, p->name)) 
+        {
+          if (ep != NULL)
+            *ep = *p;
+          if (ofsp != NULL)
+            *ofsp = ofs;
+          found = true;
+        }
+    }
+  if (block != NULL)
+    buffer_cache_put (block, false);
+  return found;
 }
 
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+
+   The file is opened before DIR's lock is released, so it cannot
+   be removed and freed in between. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  struct rwlock *dir_lock;
   struct dir_entry e;
+  block_sector_t dir_sector, sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  dir_lock = inode_dir_lock (dir->inode);
+  rwlock_acquire_read (dir_lock);
+  dir_sector = inode_get_inumber (dir->inode);
+  if (!dcache_lookup (dir_sector, name, &sector))
+    {
+      sector = lookup (dir, name, &e, NULL) ? e.inode_sector : DCACHE_NEGATIVE;
+      dcache_insert (dir_sector, name, sector);
+    }
+  if (sector != DCACHE_NEGATIVE)
+    *inode = inode_open (sector);
   else
     *inode = NULL;
+  rwlock_release_read (dir_lock);
 
   return *inode != NULL;
 }
@@ -145,6 +478,7 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   struct dir_entry e;
   off_t ofs;
+  size_t buckets;
   bool success = false;
 
   ASSERT (dir != NULL);
@@ -154,10 +488,23 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  rwlock_acquire_write (inode_dir_lock (dir->inode));
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
+  buckets = bucket_cnt (dir);
+  if (buckets > 0)
+    {
+      memset (&e, 0, sizeof e);
+      e.in_use = true;
+      strlcpy (e.name, name, sizeof e.name);
+      e.inode_sector = inode_sector;
+      success = hashed_add (dir, buckets, &e);
+      goto done;
+    }
+
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
      current end-of-file.
@@ -174,9 +521,23 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
+
+  /* A large directory that is full switches to the hashed
+     format instead of growing. */
+  if (ofs >= inode_length (dir->inode)
+      && ofs / (off_t) sizeof e >= DIR_HASH_THRESHOLD)
+    {
+      buckets = convert_to_hashed (dir);
+      if (buckets > 0)
+        success = hashed_add (dir, buckets, &e);
+      goto done;
+    }
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
  done:
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+  rwlock_release_write (inode_dir_lock (dir->inode));
   return success;
 }
 
@@ -198,6 +559,8 @@ dir_remove (struct dir *dir, const char *name)
   if (name[0] == '.')
     return false;
 
+  rwlock_acquire_write (inode_dir_lock (dir->inode));
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
@@ -211,12 +574,14 @@ dir_remove (struct dir *dir, const char *name)
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  dcache_insert (inode_get_inumber (dir->inode), name, DCACHE_NEGATIVE);
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  rwlock_release_write (inode_dir_lock (dir->inode));
   inode_close (inode);
   return success;
 }
@@ -228,15 +593,19 @@ bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool found = false;
 
+  rwlock_acquire_read (inode_dir_lock (dir->inode));
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          found = true;
+          break;
         } 
     }
-  return false;
+  rwlock_release_read (inode_dir_lock (dir->inode));
+  return found;
 }
@@ -2,6 +2,7 @@
 #include <debug.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* An open file. */
 struct file 
@@ -9,6 +10,8 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    struct inode_readahead ra;  /* Sequential read-ahead state. */
+    struct lock lock;           /* Guards POS and RA. */
   };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -23,6 +26,10 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->ra.next = 0;
+      file->ra.ahead = 0;
+      file->ra.window = 0;
+      lock_init (&file->lock);
       return file;
     }
   else
@@ -64,12 +71,18 @@ file_get_inode (struct file *file)
    starting at the file's current position.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   Advances FILE's position by the number of bytes read. */
+   Advances FILE's position by the number of bytes read.
+   Sequential reads trigger read-ahead of the data that follows. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read;
+
+  lock_acquire (&file->lock);
+  bytes_read = inode_read_ahead_at (file->inode, buffer, size,
+                                    file->pos, &file->ra);
   file->pos += bytes_read;
+  lock_release (&file->lock);
   return bytes_read;
 }
 
@@ -81,7 +94,13 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  off_t bytes_read;
+
+  lock_acquire (&file->lock);
+  bytes_read = inode_read_ahead_at (file->inode, buffer, size, file_ofs,
+                                    &file->ra);
+  lock_release (&file->lock);
+  return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -94,8 +113,12 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written;
+
+  lock_acquire (&file->lock);
+  bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_written;
+  lock_release (&file->lock);
   return bytes_written;
 }
 
@@ -155,7 +178,9 @@ file_seek (struct file *file, off_t new_pos)
 {
   ASSERT (file != NULL);
   ASSERT (new_pos >= 0);
+  lock_acquire (&file->lock);
   file->pos = new_pos;
+  lock_release (&file->lock);
 }
 
 /* Returns the current position in FILE as a byte offset from the
@@ -163,6 +188,11 @@ file_seek (struct file *file, off_t new_pos)
 off_t
 file_tell (struct file *file) 
 {
+  off_t pos;
+
   ASSERT (file != NULL);
-  return file->pos;
+  lock_acquire (&file->lock);
+  pos = file->pos;
+  lock_release (&file->lock);
+  return pos;
 }
@@ -7,6 +7,7 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "threads/thread.h"
 
 #define PATH_MAX_LEN 256
@@ -18,16 +19,6 @@ static void do_format (void);
 //proj5
 struct dir *parse_path(char *name, char *file_name);
 
-struct inode 
-  {
-    struct list_elem elem;              /* Element in inode list. */
-    block_sector_t sector;              /* Sector number of disk location. */
-    int open_cnt;                       /* Number of openers. */
-    bool removed;                       /* True if deleted, false otherwise. */
-    int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-    struct lock lock;
-  };
-
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
@@ -42,8 +33,9 @@ filesys_init (bool format)
   fs_device = block_get_role (BLOCK_FILESYS);
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
-  buffer_cache_init();
   inode_init ();
+  buffer_cache_init();
+  dcache_init ();
   free_map_init ();
 
   if (format) 
@@ -58,6 +50,7 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  inode_flush_all ();
   free_map_close ();
   buffer_cache_terminate();
 }
@@ -75,7 +68,8 @@ filesys_create (const char *name, off_t initial_size)
   struct dir *dir = parse_path(name, parse_name);
 
   bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
+                  && free_map_allocate_near (1, inode_get_inumber (dir_get_inode (dir)),
+                                             &inode_sector)
                   && inode_create (inode_sector, initial_size, false)//proj5
                   && dir_add (dir, parse_name, inode_sector));//proj5
   if (!success && inode_sector != 0) 
@@ -185,7 +179,7 @@ bool create_dir(char *name)
     block_sector_t inode_sector = 0;
     char *parse_name = (char *)malloc(sizeof(char) * (PATH_MAX_LEN + 1));
     struct dir *dir = parse_path(name, parse_name);
-    bool success = ((dir != NULL) && free_map_allocate(1, &inode_sector) && dir_create(inode_sector, 16) && dir_add(dir, parse_name, inode_sector));
+    bool success = ((dir != NULL) && free_map_allocate_spread(inode_get_inumber(dir_get_inode(dir)), &inode_sector) && dir_create(inode_sector, 16) && dir_add(dir, parse_name, inode_sector));
     if (success == true){
         dir_add(dir, ".", inode_sector);
         dir_add(dir, "..", inode_get_inumber(dir_get_inode(dir)));
@@ -1,20 +1,72 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct bitmap *dirty_sectors; /* Sectors of the free map file
+                                        that differ from FREE_MAP. */
+static struct lock free_map_lock;    /* Guards FREE_MAP and
+                                        DIRTY_SECTORS. */
+
+/* Free map bits in one sector of the free map file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+/* Sectors in an allocation group: those whose bits share one
+   sector of the free map file. */
+#define GROUP_SECTORS BITS_PER_SECTOR
+
+/* If false, free_map_allocate_near() and
+   free_map_allocate_spread() ignore their hints and allocate
+   first fit, as free_map_allocate() does. */
+static bool use_locality = true;
+
+/* Records that bits [START, START + CNT) of the free map have
+   changed since they were last written. */
+static void
+mark_dirty (block_sector_t start, size_t cnt)
+{
+  size_t first = start / BITS_PER_SECTOR;
+  size_t last = (start + cnt - 1) / BITS_PER_SECTOR;
+  bitmap_set_multiple (dirty_sectors, first, last - first + 1, true);
+}
+
+/* Allocates CNT consecutive sectors, looking from HINT onward
+   before looking from the start of the disk, and returns the
+   first of them, or BITMAP_ERROR if not enough consecutive
+   sectors are free.  FREE_MAP_LOCK must be held. */
+static block_sector_t
+allocate (size_t cnt, block_sector_t hint)
+{
+  block_sector_t sector = BITMAP_ERROR;
+
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+  if (hint > 0 && hint < bitmap_size (free_map))
+    sector = bitmap_scan_and_flip (free_map, hint, cnt, false);
+  if (sector == BITMAP_ERROR)
+    sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  if (sector != BITMAP_ERROR)
+    mark_dirty (sector, cnt);
+  return sector;
+}
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
+  lock_init (&free_map_lock);
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  dirty_sectors = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                               BLOCK_SECTOR_SIZE));
+  if (dirty_sectors == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
 }
@@ -22,31 +74,162 @@ free_map_init (void)
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available.
+   The change reaches the free map file at the next
+   free_map_sync(). */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = allocate (cnt, 0);
+  lock_release (&free_map_lock);
+  if (sector != BITMAP_ERROR)
+    *sectorp = sector;
+  return sector != BITMAP_ERROR;
+}
+
+/* Like free_map_allocate(), but looks for the CNT sectors from
+   HINT onward first, so that a file growing from its last sector,
+   or a file created next to its directory, stays contiguous. */
+bool
+free_map_allocate_near (size_t cnt, block_sector_t hint,
+                        block_sector_t *sectorp)
+{
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = allocate (cnt, use_locality ? hint : 0);
+  lock_release (&free_map_lock);
+  if (sector != BITMAP_ERROR)
+    *sectorp = sector;
+  return sector != BITMAP_ERROR;
+}
+
+/* Allocates one sector, for a new directory, in the allocation
+   group with the most free sectors, preferring HINT's group and
+   those after it on ties.  Spreading directories out leaves room
+   for the files created in each of them to sit next to it. */
+bool
+free_map_allocate_spread (block_sector_t hint, block_sector_t *sectorp)
+{
+  size_t size = bitmap_size (free_map);
+  size_t group_cnt = DIV_ROUND_UP (size, GROUP_SECTORS);
+  size_t best = 0, best_free = 0;
+  block_sector_t sector;
+  size_t i;
+
+  if (!use_locality || hint >= size)
+    return free_map_allocate (1, sectorp);
+  lock_acquire (&free_map_lock);
+  for (i = 0; i < group_cnt; i++)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      size_t group = (hint / GROUP_SECTORS + i) % group_cnt;
+      size_t start = group * GROUP_SECTORS;
+      size_t cnt = size - start < GROUP_SECTORS ? size - start : GROUP_SECTORS;
+      size_t free_cnt = bitmap_count (free_map, start, cnt, false);
+      if (free_cnt > best_free)
+        {
+          best = group;
+          best_free = free_cnt;
+        }
     }
+  sector = best_free > 0 ? allocate (1, best * GROUP_SECTORS) : BITMAP_ERROR;
+  lock_release (&free_map_lock);
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Makes CNT sectors starting at SECTOR available for use.
+   The change reaches the free map file at the next
+   free_map_sync(). */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Writes the sectors of the free map file whose bits have changed
+   since they were last written, each run of consecutive ones with
+   a single write.  Allocation waits until they are written: the
+   free map file is fully allocated when it is created, so writing
+   it never needs a sector itself. */
+void
+free_map_sync (void)
+{
+  size_t cnt, first, last;
+
+  /* The write-behind thread calls this too, before the free map
+     is opened and after it is closed. */
+  if (free_map_file == NULL)
+    return;
+  lock_acquire (&free_map_lock);
+  if (free_map_file == NULL)
+    {
+      lock_release (&free_map_lock);
+      return;
+    }
+  cnt = bitmap_size (dirty_sectors);
+  for (first = bitmap_scan (dirty_sectors, 0, 1, true);
+       first != BITMAP_ERROR;
+       first = bitmap_scan (dirty_sectors, last + 1, 1, true))
+    {
+      for (last = first; last + 1 < cnt
+             && bitmap_test (dirty_sectors, last + 1); last++)
+        continue;
+      if (!bitmap_write_range (free_map, free_map_file,
+                               first * BLOCK_SECTOR_SIZE,
+                               (last - first + 1) * BLOCK_SECTOR_SIZE))
+        PANIC ("can't write free map");
+      bitmap_set_multiple (dirty_sectors, first, last - first + 1, false);
+      if (last + 1 == cnt)
+        break;
+    }
+  lock_release (&free_map_lock);
+}
+
+/* Turns the placement of free_map_allocate_near() and
+   free_map_allocate_spread() on or off. */
+void
+free_map_set_locality (bool locality)
+{
+  use_locality = locality;
+}
+
+/* Stores the number of free sectors into *FREE_CNT, the number of
+   runs they form into *RUN_CNT and the length of the longest run
+   into *LONGEST. */
+void
+free_map_fragmentation (size_t *free_cnt, size_t *run_cnt, size_t *longest)
+{
+  size_t size = bitmap_size (free_map);
+  size_t i = 0;
+
+  *free_cnt = *run_cnt = *longest = 0;
+  lock_acquire (&free_map_lock);
+  while (i < size)
+    {
+      size_t start = bitmap_scan (free_map, i, 1, false);
+      size_t end;
+
+      if (start == BITMAP_ERROR)
+        break;
+      end = bitmap_scan (free_map, start, 1, true);
+      if (end == BITMAP_ERROR)
+        end = size;
+      *free_cnt += end - start;
+      (*run_cnt)++;
+      if (end - start > *longest)
+        *longest = end - start;
+      i = end;
+    }
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -64,7 +247,14 @@ free_map_open (void)
 void
 free_map_close (void) 
 {
-  file_close (free_map_file);
+  struct file *file;
+
+  free_map_sync ();
+  lock_acquire (&free_map_lock);
+  file = free_map_file;
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
+  file_close (file);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -77,10 +267,13 @@ free_map_create (void)
   if (inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false) == false)
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
+  /* Write bitmap to file.  The file starts out as a hole, so
+     writing it allocates its sectors, which marks the part of the
+     map that records them dirty again. */
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  bitmap_set_all (dirty_sectors, false);
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
@@ -12,6 +12,12 @@ void free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate_near (size_t, block_sector_t hint, block_sector_t *);
+bool free_map_allocate_spread (block_sector_t hint, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+void free_map_sync (void);
+void free_map_set_locality (bool);
+void free_map_fragmentation (size_t *free_cnt, size_t *run_cnt,
+                             size_t *longest);
 
 #endif /* filesys/free-map.h */
@@ -7,6 +7,8 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -221,3 +223,38 @@ fsutil_append (char **argv)
   file_close (src);
   free (buffer);
 }
+
+/* Prints how many runs the free space and the data of each file
+   in the root directory are split into. */
+void
+fsutil_frag (char **argv UNUSED)
+{
+  struct dir *dir;
+  char name[NAME_MAX + 1];
+  size_t free_cnt, run_cnt, longest;
+  size_t file_cnt = 0, frag_cnt = 0;
+
+  free_map_fragmentation (&free_cnt, &run_cnt, &longest);
+  printf ("Free space: %zu sectors in %zu runs, longest %zu.\n",
+          free_cnt, run_cnt, longest);
+
+  dir = dir_open_root ();
+  if (dir == NULL)
+    PANIC ("root dir open failed");
+  while (dir_readdir (dir, name))
+    {
+      struct inode *inode;
+      size_t frags;
+
+      if (!dir_lookup (dir, name, &inode))
+        continue;
+      frags = inode_fragments (inode);
+      printf ("%s: %"PROTd" bytes in %zu fragments\n",
+              name, inode_length (inode), frags);
+      file_cnt++;
+      frag_cnt += frags;
+      inode_close (inode);
+    }
+  dir_close (dir);
+  printf ("%zu files in %zu fragments.\n", file_cnt, frag_cnt);
+}
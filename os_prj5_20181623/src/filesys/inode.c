@@ -1,4 +1,5 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
@@ -7,25 +8,74 @@
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
 #include "filesys/cache.h"
+#include "filesys/dcache.h"
 
 
 #define INODE_MAGIC 0x494e4f44
+/* Magic number of an inode that maps its data with extents. */
+#define INODE_EXTENT_MAGIC 0x494e4f58
+/* Magic number of an inode that holds its data itself. */
+#define INODE_INLINE_MAGIC 0x494e4f49
 #define DIRECT_BLOCK_ENTRIES 123
 #define INDIRECT_BLOCK_ENTRIES 128
+/* Extents held in the inode sector and in each extent block. */
+#define INODE_EXTENTS 41
+#define EXTENT_BLOCK_ENTRIES 42
 #define SECTOR_MAGIC 0xFFFFFFFF
+/* Extents remembered by each open inode. */
+#define XLATE_RUNS 4
+/* Bounds of the read-ahead window, in sectors. */
+#define READ_AHEAD_MIN 4
+#define READ_AHEAD_MAX 64
+/* Bytes in a cluster, the unit of clustered reads. */
+#define CLUSTER_BYTES (BUFFER_CACHE_CLUSTER * BLOCK_SECTOR_SIZE)
+
+/* A run of LENGTH file sectors, starting with file sector
+   LOGICAL, stored in consecutive disk sectors from START. */
+struct extent
+{
+    block_sector_t logical;
+    block_sector_t start;
+    block_sector_t length;
+};
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+   MAGIC tells which of the two maps it holds. */
 struct inode_disk
 {
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
     //proj5
-    block_sector_t direct[DIRECT_BLOCK_ENTRIES];
-    block_sector_t indirect;
-    block_sector_t double_indirect;
+    union {
+        struct {                        /* INODE_MAGIC: sector by sector. */
+            block_sector_t direct[DIRECT_BLOCK_ENTRIES];
+            block_sector_t indirect;
+            block_sector_t double_indirect;
+        };
+        struct {                        /* INODE_EXTENT_MAGIC: by extent. */
+            uint32_t extent_cnt;
+            struct extent extents[INODE_EXTENTS];
+            block_sector_t extent_next; /* First extent block. */
+        };
+        /* INODE_INLINE_MAGIC: the data itself, zero past LENGTH. */
+        uint8_t inline_data[(DIRECT_BLOCK_ENTRIES + 2) * sizeof (block_sector_t)];
+    };
     bool is_dir;
 };
 
+/* Block holding the extents that do not fit in the inode, in a
+   list that starts at the inode's EXTENT_NEXT. */
+struct inode_extent_block
+{
+    uint32_t cnt;
+    block_sector_t next;
+    struct extent extents[EXTENT_BLOCK_ENTRIES];
+};
+
+/* Whether inode_create() makes extent-mapped inodes. */
+static bool use_extents;
+
 //proj5
 struct sector_info{
     int direct_num;
@@ -40,12 +90,27 @@ struct inode_indirect_block{
 /* In-memory inode. */
 struct inode 
 {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-    struct lock lock;
+    struct rwlock dir_lock;             /* Guards a directory's entries. */
+    struct rwlock rwlock;               /* Guards DATA, DIRTY and
+                                           DENY_WRITE_CNT: shared to look
+                                           them up, exclusive to change
+                                           them. */
+    struct inode_disk data;             /* Inode content, authoritative while open. */
+    bool dirty;                         /* DATA is newer than the cached sector. */
+    /* Translation cache, guarded by XLATE_LOCK, which is taken with
+       RWLOCK held for reading.  Mapped sectors never move while the
+       inode is open, so it only misses. */
+    struct lock xlate_lock;
+    struct extent runs[XLATE_RUNS];     /* Recently used extents. */
+    int run_next;                       /* Slot RUNS fills next. */
+    block_sector_t leaf_first;          /* File sector of LEAF's first slot,
+                                           SECTOR_MAGIC if LEAF is empty. */
+    struct inode_indirect_block leaf;   /* Copy of the last index block used. */
 };
 /* Identifies an inode. */
 
@@ -87,162 +152,625 @@ void compute_location(off_t pos, struct sector_info* sec_info)
 }
 
 //proj5
-bool make_new_sector(struct inode_disk* inode_disk, block_sector_t new, struct sector_info sec_info)
+bool make_new_sector(struct inode_disk* inode_disk, block_sector_t new, struct sector_info sec_info, block_sector_t owner)
 {
-    struct inode_indirect_block fst, snd;
+    struct buffer_cache_entry *e;
+    struct inode_indirect_block *fst, *snd;
+    bool fresh;
     if(sec_info.direct_num == 0)
         inode_disk->direct[sec_info.fst_index] = new;
 
     else if(sec_info.direct_num == 1){
-        if(inode_disk->indirect == SECTOR_MAGIC){
-            if(free_map_allocate(1, &inode_disk->indirect) == false)
-                return false;
-            memset (&snd, -1, sizeof (struct inode_indirect_block));
-        }
-        else
-            buffer_cache_read(inode_disk->indirect, &snd, 0, sizeof(struct inode_indirect_block), 0);
-        if(snd.mapping[sec_info.fst_index] == SECTOR_MAGIC)
-            snd.mapping[sec_info.fst_index] = new;
-        buffer_cache_write(inode_disk->indirect, &snd, 0, sizeof(struct inode_indirect_block), 0);
+        fresh = inode_disk->indirect == SECTOR_MAGIC;
+        if(fresh && free_map_allocate_near(1, new, &inode_disk->indirect) == false)
+            return false;
+        e = fresh ? buffer_cache_get_fresh(inode_disk->indirect, CACHE_META, owner) : buffer_cache_get(inode_disk->indirect, CACHE_META, owner);
+        snd = (struct inode_indirect_block *)e->buffer;
+        if(fresh)
+            memset (snd, -1, sizeof (struct inode_indirect_block));
+        if(snd->mapping[sec_info.fst_index] == SECTOR_MAGIC)
+            snd->mapping[sec_info.fst_index] = new;
+        buffer_cache_put(e, true);
     }
 
     else if(sec_info.direct_num == 2){
-        if(inode_disk->double_indirect == SECTOR_MAGIC){
-            if(free_map_allocate(1, &inode_disk->double_indirect) == false)
-                return false;
-            memset (&fst, -1, sizeof (struct inode_indirect_block));
-        }
-        else
-            buffer_cache_read(inode_disk->double_indirect, &fst, 0, sizeof(struct inode_indirect_block), 0);
+        block_sector_t second;
+        fresh = inode_disk->double_indirect == SECTOR_MAGIC;
+        if(fresh && free_map_allocate_near(1, new, &inode_disk->double_indirect) == false)
+            return false;
+        e = fresh ? buffer_cache_get_fresh(inode_disk->double_indirect, CACHE_META, owner) : buffer_cache_get(inode_disk->double_indirect, CACHE_META, owner);
+        fst = (struct inode_indirect_block *)e->buffer;
+        if(fresh)
+            memset (fst, -1, sizeof (struct inode_indirect_block));
+        second = fst->mapping[sec_info.fst_index];
+        buffer_cache_put(e, fresh);
 
-        if(fst.mapping[sec_info.fst_index] == SECTOR_MAGIC){
-            if(free_map_allocate(1, &fst.mapping[sec_info.fst_index]) == false)
+        fresh = second == SECTOR_MAGIC;
+        if(fresh){
+            if(free_map_allocate_near(1, new, &second) == false)
                 return false;
-            memset (&snd, -1, sizeof (struct inode_indirect_block));
-            if(snd.mapping[sec_info.snd_index] == SECTOR_MAGIC)
-                snd.mapping[sec_info.snd_index] = new;
-            buffer_cache_write(inode_disk->double_indirect, &fst, 0, sizeof(struct inode_indirect_block), 0);
-            buffer_cache_write(fst.mapping[sec_info.fst_index], &snd, 0, sizeof(struct inode_indirect_block), 0);
-        }
-        else{
-            buffer_cache_read(fst.mapping[sec_info.fst_index], &snd, 0, sizeof(struct inode_indirect_block), 0);
-            if(snd.mapping[sec_info.snd_index] == SECTOR_MAGIC)
-                snd.mapping[sec_info.snd_index] = new;
-            buffer_cache_write(fst.mapping[sec_info.fst_index], &snd, 0, sizeof(struct inode_indirect_block), 0);
+            e = buffer_cache_get(inode_disk->double_indirect, CACHE_META, owner);
+            fst = (struct inode_indirect_block *)e->buffer;
+            fst->mapping[sec_info.fst_index] = second;
+            buffer_cache_put(e, true);
         }
+        e = fresh ? buffer_cache_get_fresh(second, CACHE_META, owner) : buffer_cache_get(second, CACHE_META, owner);
+        snd = (struct inode_indirect_block *)e->buffer;
+        if(fresh)
+            memset (snd, -1, sizeof (struct inode_indirect_block));
+        if(snd->mapping[sec_info.snd_index] == SECTOR_MAGIC)
+            snd->mapping[sec_info.snd_index] = new;
+        buffer_cache_put(e, true);
     }
     else
         return false;
     return true;
 }
 
+/* Returns entry IDX of index block SECTOR of the file whose inode
+   is in sector OWNER, read in place from the buffer cache. */
+static block_sector_t
+index_lookup (block_sector_t sector, off_t idx, block_sector_t owner)
+{
+    struct buffer_cache_entry *e = buffer_cache_get (sector, CACHE_META, owner);
+    block_sector_t result = ((struct inode_indirect_block *)e->buffer)->mapping[idx];
+    buffer_cache_put (e, false);
+    return result;
+}
+
+/* Returns the extent mapping file sector IDX among the CNT
+   extents in EXTENTS, sorted by file sector, or a null pointer if
+   none of them maps it. */
+static const struct extent *
+extent_search (const struct extent *extents, uint32_t cnt, block_sector_t idx)
+{
+    uint32_t lo = 0, hi = cnt;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const struct extent *ext = &extents[mid];
+        if (idx < ext->logical)
+            hi = mid;
+        else if (idx >= ext->logical + ext->length)
+            lo = mid + 1;
+        else
+            return ext;
+    }
+    return NULL;
+}
+
+/* Returns the disk sector holding file sector IDX of the
+   extent-mapped file whose inode, in sector OWNER, is
+   INODE_DISK, or SECTOR_MAGIC.  If RUN is non-null, the extent
+   that maps IDX is copied there. */
+static block_sector_t
+extent_lookup (const struct inode_disk *inode_disk, block_sector_t idx, block_sector_t owner,
+               struct extent *run)
+{
+    struct extent found;
+    const struct extent *ext = extent_search (inode_disk->extents, inode_disk->extent_cnt, idx);
+    block_sector_t next = inode_disk->extent_next;
+    if (ext != NULL)
+        found = *ext;
+    while (ext == NULL && next != SECTOR_MAGIC) {
+        struct buffer_cache_entry *e = buffer_cache_get (next, CACHE_META, owner);
+        struct inode_extent_block *block = (struct inode_extent_block *)e->buffer;
+        ext = extent_search (block->extents, block->cnt, idx);
+        if (ext != NULL)
+            found = *ext;
+        next = block->next;
+        buffer_cache_put (e, false);
+    }
+    if (ext == NULL)
+        return SECTOR_MAGIC;
+    if (run != NULL)
+        *run = found;
+    return found.start + (idx - found.logical);
+}
+
     static block_sector_t
-byte_to_sector (const struct inode_disk *inode_disk, off_t pos) 
+byte_to_sector (const struct inode_disk *inode_disk, off_t pos, block_sector_t owner) 
 {
     //proj5
-    if (pos >= inode_disk->length)
+    if (pos >= inode_disk->length || inode_disk->magic == INODE_INLINE_MAGIC)
         return -1;
-    struct inode_indirect_block *temp = (struct inode_indirect_block *)malloc(BLOCK_SECTOR_SIZE);
-    block_sector_t result;
+    if (inode_disk->magic == INODE_EXTENT_MAGIC)
+        return extent_lookup (inode_disk, pos / BLOCK_SECTOR_SIZE, owner, NULL);
     struct sector_info sec_info;
     compute_location(pos, &sec_info);
 
-    if (sec_info.direct_num == 0){
-        free(temp);
+    if (sec_info.direct_num == 0)
         return inode_disk->direct[sec_info.fst_index];
-    }
 
     else if (sec_info.direct_num == 1){
-        if (inode_disk->indirect == SECTOR_MAGIC){
-            free(temp);
+        if (inode_disk->indirect == SECTOR_MAGIC)
             return -1;
-        }
-        buffer_cache_read(inode_disk->indirect, temp, 0, sizeof(struct inode_indirect_block), 0);
-        result = temp->mapping[sec_info.fst_index];
-        free(temp);
-        return result;
+        return index_lookup(inode_disk->indirect, sec_info.fst_index, owner);
     }
 
     else if (sec_info.direct_num == 2){
-        if (inode_disk->double_indirect == SECTOR_MAGIC){
-            free(temp);
+        block_sector_t second;
+        if (inode_disk->double_indirect == SECTOR_MAGIC)
             return -1;
-        }
-        buffer_cache_read(inode_disk->double_indirect, temp, 0, sizeof(struct inode_indirect_block), 0);
-        if (temp->mapping[sec_info.fst_index] == SECTOR_MAGIC){
-            free(temp);
+        second = index_lookup(inode_disk->double_indirect, sec_info.fst_index, owner);
+        if (second == SECTOR_MAGIC)
             return -1;
-        }
-        buffer_cache_read(temp->mapping[sec_info.fst_index], temp, 0, sizeof(struct inode_indirect_block), 0);
-        result = temp->mapping[sec_info.snd_index];
-        free(temp);
-        return result;
+        return index_lookup(second, sec_info.snd_index, owner);
     }
-    else{
-        free(temp);
+    else
         return -1;
+}
+
+/* Returns the cache class of the data sectors of the file whose
+   inode, in sector INODE_SECTOR, is INODE_DISK: directories and
+   the free map are metadata. */
+static enum cache_class
+data_class (block_sector_t inode_sector, const struct inode_disk *inode_disk)
+{
+    return inode_disk->is_dir || inode_sector == FREE_MAP_SECTOR ? CACHE_META : CACHE_DATA;
+}
+
+/* Adds LENGTH disk sectors from START, as file sectors from
+   LOGICAL, to the CNT of MAX extents in EXTENTS, growing the last
+   extent if the run continues it.  Returns false if there is no
+   room for a new extent. */
+static bool
+extent_push (struct extent *extents, uint32_t *cnt, uint32_t max,
+             block_sector_t logical, block_sector_t start, block_sector_t length)
+{
+    if (*cnt > 0) {
+        struct extent *last = &extents[*cnt - 1];
+        if (last->logical + last->length == logical && last->start + last->length == start) {
+            last->length += length;
+            return true;
+        }
     }
+    if (*cnt == max)
+        return false;
+    extents[*cnt].logical = logical;
+    extents[*cnt].start = start;
+    extents[*cnt].length = length;
+    (*cnt)++;
+    return true;
 }
 
-//proj5
-bool compute_file_length(struct inode_disk *inode_disk, off_t start, off_t end)
+/* Returns the number of file sectors mapped by the extent-mapped
+   file whose inode, in sector OWNER, is INODE_DISK, sets *TAIL to
+   its last extent block, SECTOR_MAGIC if it has none, and *NEXT_FIT
+   to the disk sector after its last extent, or after the inode if
+   it has none. */
+static block_sector_t
+extent_mapped (const struct inode_disk *inode_disk, block_sector_t *tail, block_sector_t *next_fit,
+               block_sector_t owner)
 {
-    static char zero[BLOCK_SECTOR_SIZE];
-    inode_disk->length = end;
+    block_sector_t mapped = 0;
+    block_sector_t next = inode_disk->extent_next;
+    *next_fit = owner + 1;
+    if (inode_disk->extent_cnt > 0) {
+        const struct extent *last = &inode_disk->extents[inode_disk->extent_cnt - 1];
+        mapped = last->logical + last->length;
+        *next_fit = last->start + last->length;
+    }
+    *tail = SECTOR_MAGIC;
+    while (next != SECTOR_MAGIC) {
+        struct buffer_cache_entry *e = buffer_cache_get (next, CACHE_META, owner);
+        struct inode_extent_block *block = (struct inode_extent_block *)e->buffer;
+        if (block->cnt > 0) {
+            const struct extent *last = &block->extents[block->cnt - 1];
+            mapped = last->logical + last->length;
+            *next_fit = last->start + last->length;
+        }
+        *tail = next;
+        next = block->next;
+        buffer_cache_put (e, false);
+    }
+    return mapped;
+}
+
+/* Appends the run of LENGTH disk sectors from START, as file
+   sectors from LOGICAL, to INODE_DISK, whose last extent block is
+   *TAIL, starting a new extent block when the last one is full. */
+static bool
+extent_append (struct inode_disk *inode_disk, block_sector_t *tail, block_sector_t logical,
+               block_sector_t start, block_sector_t length, block_sector_t owner)
+{
+    struct buffer_cache_entry *e;
+    struct inode_extent_block *block;
+    block_sector_t new_block;
+
+    if (*tail == SECTOR_MAGIC) {
+        if (extent_push (inode_disk->extents, &inode_disk->extent_cnt, INODE_EXTENTS, logical, start, length))
+            return true;
+        if (free_map_allocate_near(1, start + length, &new_block) == false)
+            return false;
+        inode_disk->extent_next = new_block;
+    }
+    else {
+        bool pushed;
+        e = buffer_cache_get (*tail, CACHE_META, owner);
+        block = (struct inode_extent_block *)e->buffer;
+        pushed = extent_push (block->extents, &block->cnt, EXTENT_BLOCK_ENTRIES, logical, start, length);
+        buffer_cache_put (e, pushed);
+        if (pushed)
+            return true;
+        if (free_map_allocate_near(1, start + length, &new_block) == false)
+            return false;
+        e = buffer_cache_get (*tail, CACHE_META, owner);
+        ((struct inode_extent_block *)e->buffer)->next = new_block;
+        buffer_cache_put (e, true);
+    }
+    e = buffer_cache_get_fresh (new_block, CACHE_META, owner);
+    block = (struct inode_extent_block *)e->buffer;
+    memset (block, 0, sizeof *block);
+    block->next = SECTOR_MAGIC;
+    extent_push (block->extents, &block->cnt, EXTENT_BLOCK_ENTRIES, logical, start, length);
+    buffer_cache_put (e, true);
+    *tail = new_block;
+    return true;
+}
+
+/* Maps the first SECTORS file sectors of the extent-mapped file
+   whose inode, in sector OWNER, is INODE_DISK.  Each missing run
+   is taken from the free map in one piece if possible, halving the
+   request until it fits, and looked for first right after the
+   file's last extent, so a file written sequentially needs few
+   extents. */
+static bool
+extent_grow (struct inode_disk *inode_disk, block_sector_t sectors, enum cache_class type, block_sector_t owner)
+{
+    block_sector_t tail, next_fit;
+    block_sector_t mapped = extent_mapped (inode_disk, &tail, &next_fit, owner);
+    while (mapped < sectors) {
+        block_sector_t start;
+        size_t cnt = sectors - mapped;
+        while (free_map_allocate_near(cnt, next_fit, &start) == false)
+            if ((cnt /= 2) == 0)
+                return false;
+        next_fit = start + cnt;
+        if (extent_append (inode_disk, &tail, mapped, start, cnt, owner) == false) {
+            free_map_release (start, cnt);
+            return false;
+        }
+        for (size_t i = 0; i < cnt; i++)
+            buffer_cache_put (buffer_cache_get_fresh (start + i, type, owner), true);
+        mapped += cnt;
+    }
+    return true;
+}
+
+/* Allocates and zeroes the sectors holding bytes [START, END) of
+   the block-mapped file whose inode, in sector OWNER, is
+   INODE_DISK, that are still holes.  Returns how many it
+   allocated, which may fall short if the disk is full. */
+static size_t
+fill_holes (struct inode_disk *inode_disk, off_t start, off_t end, enum cache_class type, block_sector_t owner)
+{
+    size_t filled = 0;
+    if (start >= end)
+        return 0;
+    /* Missing sectors are taken from RUN, allocated for all the
+       sectors still to go at once, or half as many if that does not
+       fit, so that the file's data ends up contiguous.  RUN is
+       looked for first right after the sector before START, or
+       after the inode if that is a hole too. */
+    block_sector_t run = 0, next_fit = owner + 1;
+    size_t run_left = 0;
     start = (start / BLOCK_SECTOR_SIZE) * BLOCK_SECTOR_SIZE;
     end = ((end - 1) / BLOCK_SECTOR_SIZE) * BLOCK_SECTOR_SIZE;
+    if(start >= BLOCK_SECTOR_SIZE){
+        block_sector_t last = byte_to_sector(inode_disk, start - BLOCK_SECTOR_SIZE, owner);
+        if(last != SECTOR_MAGIC)
+            next_fit = last + 1;
+    }
     for(;start<=end; start = start + BLOCK_SECTOR_SIZE){
-        block_sector_t sector = byte_to_sector(inode_disk, start);
+        block_sector_t sector = byte_to_sector(inode_disk, start, owner);
         if(sector == SECTOR_MAGIC){
-            if(free_map_allocate(1, &sector) == false)
-                return false;
+            if(run_left == 0){
+                run_left = (end - start) / BLOCK_SECTOR_SIZE + 1;
+                while(free_map_allocate_near(run_left, next_fit, &run) == false)
+                    if((run_left /= 2) == 0)
+                        return filled;
+                next_fit = run + run_left;
+            }
+            sector = run++;
+            run_left--;
             struct sector_info sec_info;
             compute_location(start, &sec_info);
-            if(make_new_sector(inode_disk, sector, sec_info) == false)
-                return false;
-            buffer_cache_write(sector, zero, 0, BLOCK_SECTOR_SIZE, 0);            
+            if(make_new_sector(inode_disk, sector, sec_info, owner) == false){
+                free_map_release(sector, run_left + 1);
+                return filled;
+            }
+            buffer_cache_put(buffer_cache_get_fresh(sector, type, owner), true);
+            filled++;
         }
     }
-    return true;
+    if(run_left > 0)
+        free_map_release(run, run_left);
+    return filled;
 }
 
+/* Sets the length of the file whose inode, in sector OWNER, is
+   INODE_DISK, to END bytes.  A block-mapped file only
+   grows holes, which read as zeros and get sectors when they are
+   first written; an extent-mapped one is allocated and zeroed up
+   to END. */
 //proj5
-void free_sectors(struct inode_disk *inode_disk)
-{
-    if (inode_disk->double_indirect != SECTOR_MAGIC){
-        struct inode_indirect_block *first_block = (struct inode_indirect_block *)malloc(BLOCK_SECTOR_SIZE);
-        buffer_cache_read(inode_disk->double_indirect, first_block, 0, sizeof(struct inode_indirect_block), 0);
-        for(int i = 0; first_block->mapping[i] != SECTOR_MAGIC; i++){
-            struct inode_indirect_block *second_block = (struct inode_indirect_block *)malloc(BLOCK_SECTOR_SIZE);
-            buffer_cache_read(second_block->mapping[0], second_block, 0, sizeof(struct inode_indirect_block), 0);
-            for(int j = 0; second_block->mapping[j] != SECTOR_MAGIC; j++)
-                free_map_release(second_block->mapping[j], 1);
-            free_map_release(first_block->mapping[i], 1);
-            free(second_block);    
+bool compute_file_length(struct inode_disk *inode_disk, off_t end, enum cache_class type, block_sector_t owner)
+{
+    struct sector_info sec_info;
+    inode_disk->length = end;
+    if (inode_disk->magic == INODE_EXTENT_MAGIC)
+        return extent_grow (inode_disk, bytes_to_sectors (end), type, owner);
+    /* The block map must still be able to map the last byte. */
+    compute_location(end > 0 ? end - 1 : 0, &sec_info);
+    return sec_info.direct_num != -1;
+}
+
+/* Returns the disk sector holding file sector IDX of
+   extent-mapped INODE, looking in INODE's recently used extents
+   before the extent map. */
+static block_sector_t
+xlate_extent (struct inode *inode, block_sector_t idx)
+{
+    block_sector_t sector;
+    struct extent *run;
+
+    for (int i = 0; i < XLATE_RUNS; i++) {
+        run = &inode->runs[i];
+        if (idx >= run->logical && idx - run->logical < run->length)
+            return run->start + (idx - run->logical);
+    }
+    run = &inode->runs[inode->run_next];
+    sector = extent_lookup (&inode->data, idx, inode->sector, run);
+    if (sector != SECTOR_MAGIC)
+        inode->run_next = (inode->run_next + 1) % XLATE_RUNS;
+    return sector;
+}
+
+/* Returns the disk sector holding file sector IDX of block-mapped
+   INODE.  Sectors behind an index block are looked up in INODE's
+   copy of the index block it used last, which is replaced when IDX
+   falls under another one. */
+static block_sector_t
+xlate_block (struct inode *inode, block_sector_t idx)
+{
+    struct sector_info sec_info;
+    block_sector_t leaf, first, sector;
+
+    compute_location (idx * BLOCK_SECTOR_SIZE, &sec_info);
+    if (sec_info.direct_num == 0)
+        return inode->data.direct[sec_info.fst_index];
+    if (sec_info.direct_num == 1)
+        first = DIRECT_BLOCK_ENTRIES;
+    else if (sec_info.direct_num == 2)
+        first = DIRECT_BLOCK_ENTRIES + INDIRECT_BLOCK_ENTRIES
+                + sec_info.fst_index * INDIRECT_BLOCK_ENTRIES;
+    else
+        return SECTOR_MAGIC;
+
+    /* A slot still unused in the copy may have been filled since. */
+    if (inode->leaf_first == first) {
+        sector = inode->leaf.mapping[idx - first];
+        if (sector != SECTOR_MAGIC)
+            return sector;
+    }
+    if (sec_info.direct_num == 1)
+        leaf = inode->data.indirect;
+    else if (inode->data.double_indirect == SECTOR_MAGIC)
+        leaf = SECTOR_MAGIC;
+    else
+        leaf = index_lookup (inode->data.double_indirect, sec_info.fst_index, inode->sector);
+    if (leaf == SECTOR_MAGIC)
+        return SECTOR_MAGIC;
+    buffer_cache_read (leaf, &inode->leaf, 0, BLOCK_SECTOR_SIZE, 0, CACHE_META, inode->sector);
+    inode->leaf_first = first;
+    return inode->leaf.mapping[idx - first];
+}
+
+/* Returns the disk sector holding byte POS of INODE, as
+   byte_to_sector() does, but through INODE's translation cache.
+   INODE's rwlock must be held, in either mode. */
+static block_sector_t
+inode_map_held (struct inode *inode, off_t pos)
+{
+    block_sector_t sector = SECTOR_MAGIC;
+    if (pos < inode->data.length && inode->data.magic != INODE_INLINE_MAGIC) {
+        lock_acquire (&inode->xlate_lock);
+        if (inode->data.magic == INODE_EXTENT_MAGIC)
+            sector = xlate_extent (inode, pos / BLOCK_SECTOR_SIZE);
+        else
+            sector = xlate_block (inode, pos / BLOCK_SECTOR_SIZE);
+        lock_release (&inode->xlate_lock);
+    }
+    return sector;
+}
+
+/* Like inode_map_held(), but takes INODE's rwlock for reading. */
+static block_sector_t
+inode_map (struct inode *inode, off_t pos)
+{
+    block_sector_t sector;
+    rwlock_acquire_read (&inode->rwlock);
+    sector = inode_map_held (inode, pos);
+    rwlock_release_read (&inode->rwlock);
+    return sector;
+}
+
+/* Brings the sectors holding bytes [START, END) of INODE, which
+   is LENGTH bytes long, into the buffer cache, reading each
+   physically contiguous run of up to BUFFER_CACHE_CLUSTER of them
+   with one disk request.  If PREFETCH, the runs are queued for
+   the read-ahead thread instead.  Returns the number of sectors
+   read. */
+static size_t
+load_clustered (struct inode *inode, off_t length, off_t start, off_t end,
+                enum cache_class type, bool prefetch)
+{
+    block_sector_t owner = inode->sector;
+    block_sector_t first = 0;
+    size_t cnt = 0, loaded = 0;
+
+    if (end > length)
+        end = length;
+    for (off_t pos = ROUND_DOWN (start, BLOCK_SECTOR_SIZE); pos < end + BLOCK_SECTOR_SIZE;
+         pos += BLOCK_SECTOR_SIZE) {
+        block_sector_t sector = pos < end ? inode_map (inode, pos) : SECTOR_MAGIC;
+        if (cnt > 0 && (sector != first + cnt || cnt == BUFFER_CACHE_CLUSTER)) {
+            if (prefetch)
+                buffer_cache_read_ahead (first, cnt, type, owner);
+            else
+                loaded += buffer_cache_fill (first, cnt, type, owner, false);
+            cnt = 0;
         }
-        free(first_block);
+        if (sector == SECTOR_MAGIC)
+            continue;
+        if (cnt++ == 0)
+            first = sector;
+    }
+    return loaded;
+}
+
+/* Releases the first sectors of index block SECTOR, up to the
+   first unused slot, and then SECTOR itself.  If DEPTH is 2 the
+   slots point to further index blocks. */
+static void
+free_index_block (block_sector_t sector, int depth, block_sector_t owner)
+{
+    struct buffer_cache_entry *e = buffer_cache_get (sector, CACHE_META, owner);
+    struct inode_indirect_block *block = (struct inode_indirect_block *)e->buffer;
+    for (int i = 0; i < INDIRECT_BLOCK_ENTRIES; i++) {
+        if (block->mapping[i] == SECTOR_MAGIC)
+            continue;
+        if (depth == 2)
+            free_index_block (block->mapping[i], 1, owner);
+        else
+            free_map_release (block->mapping[i], 1);
     }
-    else if (inode_disk->indirect != SECTOR_MAGIC){
-        struct inode_indirect_block *first_block = (struct inode_indirect_block *)malloc(BLOCK_SECTOR_SIZE);
-        buffer_cache_read(inode_disk->indirect, first_block, 0, sizeof(struct inode_indirect_block), 0);
-        for(int i = 0; first_block->mapping[i] != SECTOR_MAGIC; i++)
-            free_map_release(first_block->mapping[i], 1);
-        free(first_block);
+    buffer_cache_put (e, false);
+    free_map_release (sector, 1);
+}
+
+/* Releases the sectors of the extent-mapped file whose inode, in
+   sector OWNER, is INODE_DISK, and its extent blocks. */
+static void
+free_extents (struct inode_disk *inode_disk, block_sector_t owner)
+{
+    block_sector_t next = inode_disk->extent_next;
+    for (uint32_t i = 0; i < inode_disk->extent_cnt; i++)
+        free_map_release (inode_disk->extents[i].start, inode_disk->extents[i].length);
+    while (next != SECTOR_MAGIC) {
+        struct inode_extent_block block;
+        block_sector_t sector = next;
+        struct buffer_cache_entry *e = buffer_cache_get (sector, CACHE_META, owner);
+        memcpy (&block, e->buffer, sizeof block);
+        buffer_cache_put (e, false);
+        for (uint32_t i = 0; i < block.cnt; i++)
+            free_map_release (block.extents[i].start, block.extents[i].length);
+        next = block.next;
+        free_map_release (sector, 1);
     }
-    else{
-        for(int i = 0; inode_disk->direct[i] != SECTOR_MAGIC; i++)
-            free_map_release(inode_disk->direct[i], 1);
+}
+
+//proj5
+void free_sectors(struct inode_disk *inode_disk, block_sector_t owner)
+{
+    if (inode_disk->magic == INODE_INLINE_MAGIC)
+        return;
+    if (inode_disk->magic == INODE_EXTENT_MAGIC) {
+        free_extents (inode_disk, owner);
+        return;
     }
+    for (int i = 0; i < DIRECT_BLOCK_ENTRIES; i++)
+        if (inode_disk->direct[i] != SECTOR_MAGIC)
+            free_map_release(inode_disk->direct[i], 1);
+    if (inode_disk->indirect != SECTOR_MAGIC)
+        free_index_block(inode_disk->indirect, 1, owner);
+    if (inode_disk->double_indirect != SECTOR_MAGIC)
+        free_index_block(inode_disk->double_indirect, 2, owner);
 }
 
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
-static struct list open_inodes;
+static struct hash open_inodes;
+/* Guards open_inodes and every inode's open_cnt. */
+static struct lock open_inodes_lock;
+
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+    return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED)
+{
+    return hash_entry (a, struct inode, elem)->sector < hash_entry (b, struct inode, elem)->sector;
+}
+
+/* Gives INODE_DISK no data and an empty map in the format new
+   inodes use, keeping only IS_DIR. */
+static void
+init_map (struct inode_disk *inode_disk)
+{
+    bool is_dir = inode_disk->is_dir;
+    memset (inode_disk, -1, sizeof *inode_disk);
+    inode_disk->length = 0;
+    inode_disk->is_dir = is_dir;
+    inode_disk->magic = INODE_MAGIC;
+    if (use_extents == true) {
+        inode_disk->magic = INODE_EXTENT_MAGIC;
+        inode_disk->extent_cnt = 0;
+    }
+}
+
+/* Moves the data of inline INODE out to a sector of its own, so
+   that it can grow past its inode.  INODE's rwlock must be held
+   for writing. */
+static bool
+inline_migrate (struct inode *inode)
+{
+    uint8_t data[sizeof inode->data.inline_data];
+    off_t length = inode->data.length;
+    enum cache_class type = data_class (inode->sector, &inode->data);
+    block_sector_t sector;
+
+    memcpy (data, inode->data.inline_data, sizeof data);
+    init_map (&inode->data);
+    if (compute_file_length (&inode->data, length, type, inode->sector) == false)
+        goto fail;
+    if (inode->data.magic != INODE_EXTENT_MAGIC)
+        fill_holes (&inode->data, 0, length, type, inode->sector);
+    sector = length > 0 ? byte_to_sector (&inode->data, 0, inode->sector) : 0;
+    if (sector == SECTOR_MAGIC)
+        goto fail;
+    if (length > 0)
+        buffer_cache_write (sector, data, 0, length, 0, type, inode->sector);
+    inode->dirty = true;
+    return true;
+
+ fail:
+    /* Give back the sectors it did get: an inline inode has no
+       map left to find them through. */
+    free_sectors (&inode->data, inode->sector);
+    inode->data.magic = INODE_INLINE_MAGIC;
+    inode->data.length = length;
+    memcpy (inode->data.inline_data, data, sizeof data);
+    return false;
+}
 
 /* Initializes the inode module. */
     void
 inode_init (void) {
-    list_init (&open_inodes);
+    hash_init (&open_inodes, inode_hash, inode_less, NULL);
+    lock_init (&open_inodes_lock);
+}
+
+/* Makes inodes created from now on map their data with extents
+   if EXTENTS, or sector by sector otherwise.  Existing inodes
+   keep their format. */
+void
+inode_use_extents (bool extents)
+{
+    use_extents = extents;
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -259,14 +787,19 @@ inode_create (block_sector_t sector, off_t length, bool is_dir)
     ASSERT(sizeof *disk_inode == BLOCK_SECTOR_SIZE);
     if(disk_inode == NULL)
         return false;
-    memset (disk_inode, -1, sizeof (struct inode_disk));
-    disk_inode->magic = INODE_MAGIC;
     disk_inode->is_dir = is_dir;
-    if (compute_file_length(disk_inode, disk_inode->length, length) == false){
+    init_map(disk_inode);
+    /* A small file lives in its inode until it outgrows it. */
+    if (is_dir == false && sector != FREE_MAP_SECTOR && (size_t) length <= sizeof disk_inode->inline_data) {
+        disk_inode->magic = INODE_INLINE_MAGIC;
+        memset (disk_inode->inline_data, 0, sizeof disk_inode->inline_data);
+        disk_inode->length = length;
+    }
+    else if (compute_file_length(disk_inode, length, data_class(sector, disk_inode), sector) == false){
         free(disk_inode);
         return false;
     }
-    buffer_cache_write(sector, disk_inode, 0, BLOCK_SECTOR_SIZE, 0);
+    buffer_cache_write(sector, disk_inode, 0, BLOCK_SECTOR_SIZE, 0, CACHE_META, sector);
     free(disk_inode);
     return true;
 }
@@ -277,40 +810,95 @@ inode_create (block_sector_t sector, off_t length, bool is_dir)
     struct inode *
 inode_open (block_sector_t sector)
 {
-    struct list_elem *e;
+    struct inode key;
+    struct hash_elem *e;
     struct inode *inode;
 
-    /* Check whether this inode is already open. */
-    for (e = list_begin (&open_inodes); e != list_end (&open_inodes); e = list_next (e)) {
-        inode = list_entry (e, struct inode, elem);
-        if (inode->sector == sector) {
-            inode_reopen (inode);
-            return inode; 
-        }
+    /* Check whether this inode is already open.  If it is, it may
+       still be being read in by its first opener, who holds its
+       rwlock for writing until it is done. */
+    key.sector = sector;
+    lock_acquire (&open_inodes_lock);
+    e = hash_find (&open_inodes, &key.elem);
+    if (e != NULL) {
+        inode = hash_entry (e, struct inode, elem);
+        inode->open_cnt++;
+        lock_release (&open_inodes_lock);
+        rwlock_acquire_read (&inode->rwlock);
+        rwlock_release_read (&inode->rwlock);
+        return inode;
     }
 
     /* Allocate memory. */
     inode = malloc (sizeof *inode);
-    if (inode == NULL)
+    if (inode == NULL) {
+        lock_release (&open_inodes_lock);
         return NULL;
+    }
 
     /* Initialize. */
-    list_push_front (&open_inodes, &inode->elem);
     inode->sector = sector;
     inode->open_cnt = 1;
     inode->deny_write_cnt = 0;
     inode->removed = false;
     //proj5
-    lock_init(&inode->lock);
+    rwlock_init(&inode->rwlock);
+    rwlock_init(&inode->dir_lock);
+    lock_init(&inode->xlate_lock);
+    rwlock_acquire_write(&inode->rwlock);
+    hash_insert (&open_inodes, &inode->elem);
+    lock_release (&open_inodes_lock);
+
+    buffer_cache_open_owner(sector);
+    buffer_cache_read(sector, &inode->data, 0, BLOCK_SECTOR_SIZE, 0, CACHE_META, sector);
+    inode->dirty = false;
+    memset (inode->runs, 0, sizeof inode->runs);
+    inode->run_next = 0;
+    inode->leaf_first = SECTOR_MAGIC;
+    rwlock_release_write(&inode->rwlock);
     return inode;
 }
 
+/* Copies INODE's in-memory inode_disk into the buffer cache if it
+   has changed since it was last written.  INODE's rwlock must be
+   held for writing. */
+static void
+inode_write_back (struct inode *inode)
+{
+    ASSERT (rwlock_held_by_current_thread (&inode->rwlock));
+    if (inode->dirty == true) {
+        buffer_cache_write(inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE, 0, CACHE_META, inode->sector);
+        inode->dirty = false;
+    }
+}
+
+/* Copies every open inode that has changed into the buffer cache,
+   so that a flush of the cache makes them durable. */
+void
+inode_flush_all (void)
+{
+    struct hash_iterator i;
+
+    lock_acquire (&open_inodes_lock);
+    hash_first (&i, &open_inodes);
+    while (hash_next (&i)) {
+        struct inode *inode = hash_entry (hash_cur (&i), struct inode, elem);
+        rwlock_acquire_write (&inode->rwlock);
+        inode_write_back (inode);
+        rwlock_release_write (&inode->rwlock);
+    }
+    lock_release (&open_inodes_lock);
+}
+
 /* Reopens and returns INODE. */
     struct inode *
 inode_reopen (struct inode *inode)
 {
-    if (inode != NULL)
+    if (inode != NULL) {
+        lock_acquire (&open_inodes_lock);
         inode->open_cnt++;
+        lock_release (&open_inodes_lock);
+    }
     return inode;
 }
 
@@ -330,20 +918,41 @@ inode_close (struct inode *inode)
     if (inode == NULL)
         return;
     /* Release resources if this was the last opener. */
-    if (--inode->open_cnt == 0)
-    {
-        /* Remove from inode list and release lock. */
-        list_remove (&inode->elem);
-        /* Deallocate blocks if removed. */
-        if (inode->removed){
-            //proj5
-            struct inode_disk inode_disk;
-            buffer_cache_read(inode->sector, &inode_disk, 0, BLOCK_SECTOR_SIZE, 0);
-            free_sectors(&inode_disk);
-            free_map_release (inode->sector, 1);
-        }
-        free (inode); 
+    lock_acquire (&open_inodes_lock);
+
+    /* The last opener writes the inode back before it leaves the
+       table, so that the next opener reads what it holds.  That
+       may wait for the disk, so the table is unlocked meanwhile;
+       whoever opens the inode in between may change it again, so
+       check once more afterward.  With no other opener left, only
+       inode_flush_all() touches DIRTY, and it holds the table lock
+       while it does. */
+    while (inode->open_cnt == 1 && inode->removed == false && inode->dirty == true) {
+        lock_release (&open_inodes_lock);
+        rwlock_acquire_write(&inode->rwlock);
+        inode_write_back(inode);
+        rwlock_release_write(&inode->rwlock);
+        lock_acquire (&open_inodes_lock);
+    }
+    if (--inode->open_cnt > 0) {
+        lock_release (&open_inodes_lock);
+        return;
+    }
+    hash_delete (&open_inodes, &inode->elem);
+    lock_release (&open_inodes_lock);
+
+    /* Deallocate blocks if removed. */
+    if (inode->removed){
+        //proj5
+        free_sectors(&inode->data, inode->sector);
+        buffer_cache_forget_owner (inode->sector);
+        free_map_release (inode->sector, 1);
+        if (inode->data.is_dir)
+            dcache_forget_dir (inode->sector);
     }
+    else
+        buffer_cache_close_owner (inode->sector);
+    free (inode); 
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -352,7 +961,9 @@ inode_close (struct inode *inode)
 inode_remove (struct inode *inode) 
 {
     ASSERT (inode != NULL);
+    lock_acquire (&open_inodes_lock);
     inode->removed = true;
+    lock_release (&open_inodes_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -361,35 +972,93 @@ inode_remove (struct inode *inode)
     off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
-    struct inode_disk inode_disk;
+    return inode_read_ahead_at (inode, buffer_, size, offset, NULL);
+}
+
+/* Like inode_read_at(), but if RA is non-null and this read picks
+   up where the previous one left off, also queues the sectors
+   that follow for read-ahead.  The window doubles while reads
+   find their sectors cached and halves when they miss. */
+    off_t
+inode_read_ahead_at (struct inode *inode, void *buffer_, off_t size, off_t offset,
+                     struct inode_readahead *ra)
+{
     uint8_t *buffer = buffer_;
     off_t bytes_read = 0;
     uint8_t *bounce = NULL;
+    bool sequential = ra != NULL && offset == ra->next;
+    int miss_cnt = 0;
+    enum cache_class type;
+    off_t length;
     //proj5
-    lock_acquire(&inode->lock);
-    buffer_cache_read(inode->sector, &inode_disk, 0, sizeof(struct inode_disk), 0);
-    lock_release(&inode->lock);
+    rwlock_acquire_read(&inode->rwlock);
+    length = inode->data.length;
+    type = data_class(inode->sector, &inode->data);
+    if (inode->data.magic == INODE_INLINE_MAGIC) {
+        if (offset < length) {
+            bytes_read = size < length - offset ? size : length - offset;
+            memcpy (buffer, inode->data.inline_data + offset, bytes_read);
+        }
+        rwlock_release_read(&inode->rwlock);
+        return bytes_read;
+    }
+    rwlock_release_read(&inode->rwlock);
     while (size > 0) {
         /* Disk sector to read, starting byte offset within sector. */
         //proj5
-        block_sector_t sector_idx = byte_to_sector (&inode_disk, offset);
         int sector_ofs = offset % BLOCK_SECTOR_SIZE;
         /* Bytes left in inode, bytes left in sector, lesser of the two. */
         //proj5
-        off_t inode_left = inode_disk.length - offset;
+        off_t inode_left = length - offset;
         int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
         int min_left = inode_left < sector_left ? inode_left : sector_left;
         /* Number of bytes to actually copy out of this sector. */
         int chunk_size = size < min_left ? size : min_left;
         if (chunk_size <= 0)
             break;
+        block_sector_t sector_idx = inode_map (inode, offset);
+        /* Entering a new cluster of the file: if the read goes on
+           past this sector, load the rest of the cluster it
+           needs first. */
+        if (bytes_read == 0 || offset % CLUSTER_BYTES == 0) {
+            off_t cluster_end = ROUND_DOWN (offset, CLUSTER_BYTES) + CLUSTER_BYTES;
+            if (cluster_end > offset + size)
+                cluster_end = offset + size;
+            if ((cluster_end - 1) / BLOCK_SECTOR_SIZE > offset / BLOCK_SECTOR_SIZE)
+                miss_cnt += load_clustered (inode, length, offset, cluster_end, type, false);
+        }
         //proj5
-        buffer_cache_read(sector_idx, buffer, bytes_read, chunk_size, sector_ofs);
+        if (sector_idx == SECTOR_MAGIC)
+            memset (buffer + bytes_read, 0, chunk_size);
+        else if (buffer_cache_read(sector_idx, buffer, bytes_read, chunk_size, sector_ofs, type, inode->sector) == false)
+            miss_cnt++;
         /* Advance. */
         size -= chunk_size;
         offset += chunk_size;
         bytes_read += chunk_size;
     }
+
+    if (ra != NULL) {
+        if (!sequential)
+            ra->window = 0;
+        else if (ra->window == 0)
+            ra->window = READ_AHEAD_MIN;
+        else if (miss_cnt == 0)
+            ra->window = ra->window * 2 < READ_AHEAD_MAX ? ra->window * 2 : READ_AHEAD_MAX;
+        else
+            ra->window = ra->window / 2 > READ_AHEAD_MIN ? ra->window / 2 : READ_AHEAD_MIN;
+        ra->next = offset;
+        if (ra->window == 0 || ra->ahead < offset)
+            ra->ahead = offset;
+        off_t limit = offset + ra->window * BLOCK_SECTOR_SIZE;
+        if (limit > length)
+            limit = length;
+        ra->ahead = ROUND_DOWN (ra->ahead, BLOCK_SECTOR_SIZE);
+        if (ra->ahead < limit) {
+            load_clustered (inode, length, ra->ahead, limit, type, true);
+            ra->ahead = ROUND_UP (limit, BLOCK_SECTOR_SIZE);
+        }
+    }
     return bytes_read;
 }
 
@@ -401,43 +1070,109 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
     off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size, off_t offset) 
 {
-    struct inode_disk inode_disk;
     const uint8_t *buffer = buffer_;
     off_t bytes_written = 0;
     uint8_t *bounce = NULL;
+    enum cache_class type;
+    off_t length, end;
+    bool exclusive;
 
-    if (inode->deny_write_cnt)
-        return 0;
     //proj5
-    lock_acquire(&inode->lock);
-    buffer_cache_read(inode->sector, &inode_disk, 0, sizeof(struct inode_disk), 0);
-    if (inode_disk.length < offset + size){
-        if(compute_file_length(&inode_disk, inode_disk.length, offset + size) == true)
-            buffer_cache_write(inode->sector, &inode_disk, 0, BLOCK_SECTOR_SIZE, 0);
+    /* Only a write that changes the inode itself shuts readers out.
+       Either way the rwlock is held until the data is in, so that
+       inode_deny_write(), which takes it for writing, waits for
+       writes already under way. */
+    rwlock_acquire_read(&inode->rwlock);
+    if (inode->deny_write_cnt) {
+        rwlock_release_read(&inode->rwlock);
+        return 0;
+    }
+    length = inode->data.length;
+    type = data_class(inode->sector, &inode->data);
+    exclusive = inode->data.magic == INODE_INLINE_MAGIC || length < offset + size;
+    /* A write that extends the file keeps the inode locked until
+       its data is in, so that no reader sees the new length before
+       the bytes that go with it. */
+    if (exclusive == true) {
+        rwlock_release_read(&inode->rwlock);
+        rwlock_acquire_write(&inode->rwlock);
+        /* Writes may have been denied while it was unlocked. */
+        if (inode->deny_write_cnt) {
+            rwlock_release_write(&inode->rwlock);
+            return 0;
+        }
+        length = inode->data.length;
+        if (inode->data.magic == INODE_INLINE_MAGIC) {
+            if ((size_t) (offset + size) <= sizeof inode->data.inline_data) {
+                memcpy (inode->data.inline_data + offset, buffer, size);
+                if (length < offset + size)
+                    inode->data.length = offset + size;
+                inode->dirty = true;
+                rwlock_release_write(&inode->rwlock);
+                return size;
+            }
+            if (inline_migrate (inode) == false) {
+                rwlock_release_write(&inode->rwlock);
+                return 0;
+            }
+        }
+        if (length < offset + size){
+            /* A failed extension leaves the sectors it did get mapped
+               past the end of file, where the next one reuses them. */
+            if(compute_file_length(&inode->data, offset + size, type, inode->sector) == true)
+                inode->dirty = true;
+            else
+                inode->data.length = length;
+            length = inode->data.length;
+        }
     }
-    lock_release(&inode->lock);
+    end = offset + size < length ? offset + size : length;
 
     while (size > 0) {
         /* Sector to write, starting byte offset within sector. */
         //proj5
-        block_sector_t sector_idx = byte_to_sector (&inode_disk, offset);
         int sector_ofs = offset % BLOCK_SECTOR_SIZE;
         /* Bytes left in inode, bytes left in sector, lesser of the two. */
         //proj5
-        off_t inode_left = inode_disk.length - offset;
+        off_t inode_left = length - offset;
         int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
         int min_left = inode_left < sector_left ? inode_left : sector_left;
         /* Number of bytes to actually write into this sector. */
         int chunk_size = size < min_left ? size : min_left;
         if (chunk_size <= 0)
             break;
+        block_sector_t sector_idx = inode_map_held (inode, offset);
+        if (sector_idx == SECTOR_MAGIC) {
+            /* A hole in a block-mapped file: give it, and the rest
+               of the holes this write covers, their sectors.  That
+               needs the rwlock for writing, which is kept for the
+               rest of the write.  If filling fails part way, the
+               write stops at the first hole left. */
+            if (exclusive == false) {
+                rwlock_release_read(&inode->rwlock);
+                rwlock_acquire_write(&inode->rwlock);
+                exclusive = true;
+                if (inode->deny_write_cnt)
+                    break;
+            }
+            if (inode->data.magic != INODE_EXTENT_MAGIC
+                && fill_holes(&inode->data, offset, end, type, inode->sector) > 0)
+                inode->dirty = true;
+            sector_idx = inode_map_held (inode, offset);
+            if (sector_idx == SECTOR_MAGIC)
+                break;
+        }
         //proj5
-        buffer_cache_write(sector_idx, buffer, bytes_written, chunk_size, sector_ofs);
+        buffer_cache_write(sector_idx, buffer, bytes_written, chunk_size, sector_ofs, type, inode->sector);
         /* Advance. */
         size -= chunk_size;
         offset += chunk_size;
         bytes_written += chunk_size;
     }
+    if (exclusive == true)
+        rwlock_release_write(&inode->rwlock);
+    else
+        rwlock_release_read(&inode->rwlock);
     return bytes_written;
 }
 
@@ -446,8 +1181,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size, off_t offs
     void
 inode_deny_write (struct inode *inode) 
 {
+    rwlock_acquire_write (&inode->rwlock);
     inode->deny_write_cnt++;
     ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+    rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -456,9 +1193,11 @@ inode_deny_write (struct inode *inode)
     void
 inode_allow_write (struct inode *inode) 
 {
+    rwlock_acquire_write (&inode->rwlock);
     ASSERT (inode->deny_write_cnt > 0);
     ASSERT (inode->deny_write_cnt <= inode->open_cnt);
     inode->deny_write_cnt--;
+    rwlock_release_write (&inode->rwlock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -466,11 +1205,7 @@ inode_allow_write (struct inode *inode)
 inode_length (const struct inode *inode)
 {
     //proj5
-    struct inode_disk* temp = (struct inode_disk*)malloc(BLOCK_SECTOR_SIZE);
-    buffer_cache_read(inode->sector, temp, 0, BLOCK_SECTOR_SIZE, 0);
-    off_t length = temp->length;
-    free(temp);
-    return length;
+    return inode->data.length;
 }
 
 //proj5
@@ -478,9 +1213,55 @@ bool inode_is_dir(struct inode *inode)
 {
     if (inode->removed)
         return false;
-    struct inode_disk* temp = (struct inode_disk*)malloc(BLOCK_SECTOR_SIZE);
-    buffer_cache_read(inode->sector, temp, 0, BLOCK_SECTOR_SIZE, 0);
-    bool check = temp->is_dir;
-    free(temp);
-    return check;
+    return inode->data.is_dir;
+}
+
+/* Returns the lock that guards the entries of directory INODE.
+   Lookups hold it for reading, changes for writing. */
+struct rwlock *
+inode_dir_lock (struct inode *inode)
+{
+    return &inode->dir_lock;
+}
+
+/* Writes INODE's dirty sectors, and the free map that records
+   which sectors it uses, to disk. */
+void
+inode_sync (struct inode *inode)
+{
+    rwlock_acquire_write (&inode->rwlock);
+    inode_write_back (inode);
+    rwlock_release_write (&inode->rwlock);
+    free_map_sync ();
+    buffer_cache_flush_owner (inode->sector);
+    buffer_cache_flush_owner (FREE_MAP_SECTOR);
+}
+
+/* Returns the buffer cache entry holding the byte at offset POS
+   in INODE, obtained with buffer_cache_get(), or a null pointer
+   if POS is past the end of INODE or in a hole, which reads as
+   zeros.  The caller must release it
+   with buffer_cache_put(). */
+struct buffer_cache_entry *
+inode_get_block (struct inode *inode, off_t pos)
+{
+    block_sector_t sector = inode_map (inode, pos);
+    enum cache_class type = data_class (inode->sector, &inode->data);
+    return sector != SECTOR_MAGIC ? buffer_cache_get (sector, type, inode->sector) : NULL;
+}
+
+/* Returns the number of runs of consecutive disk sectors that
+   INODE's data is stored in. */
+size_t
+inode_fragments (struct inode *inode)
+{
+    size_t cnt = 0;
+    block_sector_t prev = SECTOR_MAGIC;
+    for (off_t pos = 0; pos < inode_length (inode); pos += BLOCK_SECTOR_SIZE) {
+        block_sector_t sector = inode_map (inode, pos);
+        if (sector != SECTOR_MAGIC && sector != prev + 1)
+            cnt++;
+        prev = sector;
+    }
+    return cnt;
 }
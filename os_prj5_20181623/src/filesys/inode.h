@@ -8,8 +8,19 @@
 
 
 struct bitmap;
+struct rwlock;
+struct buffer_cache_entry;
+
+/* Sequential read-ahead state kept by each opener of an inode. */
+struct inode_readahead
+  {
+    off_t next;                 /* Where a sequential read starts. */
+    off_t ahead;                /* Prefetch has been queued up to here. */
+    int window;                 /* Sectors to keep prefetched, 0 if off. */
+  };
 
 void inode_init (void);
+void inode_use_extents (bool);
 bool inode_create (block_sector_t, off_t, bool);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
@@ -17,11 +28,18 @@ block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+off_t inode_read_ahead_at (struct inode *, void *, off_t size, off_t offset,
+                           struct inode_readahead *);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
 //proj5
 bool inode_is_dir(struct inode*);
+struct buffer_cache_entry *inode_get_block (struct inode *, off_t pos);
+void inode_sync (struct inode *);
+void inode_flush_all (void);
+size_t inode_fragments (struct inode *);
+struct rwlock *inode_dir_lock (struct inode *);
 
 #endif /* filesys/inode.h */
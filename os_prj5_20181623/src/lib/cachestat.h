@@ -0,0 +1,34 @@
+#ifndef __LIB_CACHESTAT_H
+#define __LIB_CACHESTAT_H
+
+/* Buffer cache statistics, as kept by the kernel and returned by
+   the cachestat() system call. */
+
+#include <stdint.h>
+
+/* Counters for one class of cached sectors. */
+struct cache_class_stat
+  {
+    uint32_t hits;              /* Requests found in the cache. */
+    uint32_t misses;            /* Requests that had to be loaded. */
+    uint32_t evictions;         /* Sectors replaced by others. */
+    uint32_t dirty_evictions;   /* Of those, how many had to be
+                                   written back first. */
+    uint32_t writebacks;        /* Dirty sectors written to disk. */
+    uint32_t prefetches;        /* Sectors loaded by read-ahead. */
+    uint32_t prefetch_hits;     /* Of those, how many were used. */
+    int64_t io_ticks;           /* Timer ticks spent waiting on disk. */
+  };
+
+/* Counters for the whole cache or for the sectors of one file.
+   Metadata is inodes, index blocks, directories and the free
+   map; everything else is data. */
+struct cache_stat
+  {
+    uint32_t size;              /* Entries in the cache. */
+    uint32_t dirty;             /* Of those, how many are dirty. */
+    struct cache_class_stat meta;
+    struct cache_class_stat data;
+  };
+
+#endif /* lib/cachestat.h */
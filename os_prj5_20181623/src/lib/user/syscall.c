@@ -201,6 +201,24 @@ inumber (int fd)
   return syscall1 (SYS_INUMBER, fd);
 }
 
+bool
+cachestat (int fd, struct cache_stat *stat)
+{
+  return syscall2 (SYS_CACHESTAT, fd, stat);
+}
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+void
+sync (void)
+{
+  syscall0 (SYS_SYNC);
+}
+
 int
 fibonacci (int n)
 {
@@ -36,6 +36,9 @@
 #include "devices/ide.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/cache.h"
+#include "filesys/inode.h"
+#include "filesys/free-map.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -49,6 +52,20 @@ static bool format_filesys;
    overriding the defaults. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
+
+/* -cache, -cache-max: Initial and maximum number of buffer cache
+   entries, 0 for the default. */
+static size_t cache_sector_cnt;
+static size_t cache_sector_max;
+
+/* -wb-interval, -wb-ratio: Write-behind period in timer ticks
+   and dirty share, in percent, that triggers an early flush. */
+static int64_t write_behind_interval;
+static unsigned write_behind_ratio;
+
+/* -cache-meta: Percentage of the buffer cache reserved for
+   metadata, -1 for the default. */
+static int cache_meta_pct = -1;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
@@ -124,6 +141,11 @@ main (void)
   /* Initialize file system. */
   ide_init ();
   locate_block_devices ();
+  buffer_cache_configure (cache_sector_cnt, cache_sector_max);
+  buffer_cache_configure_write_behind (write_behind_interval,
+                                       write_behind_ratio);
+  if (cache_meta_pct >= 0)
+    buffer_cache_configure_meta (cache_meta_pct);
   filesys_init (format_filesys);
 #endif
 
@@ -247,6 +269,32 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-cache"))
+        cache_sector_cnt = atoi (value);
+      else if (!strcmp (name, "-cache-max"))
+        cache_sector_max = atoi (value);
+      else if (!strcmp (name, "-wb-interval"))
+        write_behind_interval = atoi (value);
+      else if (!strcmp (name, "-wb-ratio"))
+        write_behind_ratio = atoi (value);
+      else if (!strcmp (name, "-cache-policy"))
+        {
+          if (!buffer_cache_set_policy (value))
+            PANIC ("unknown cache policy `%s' (use -h for help)", value);
+        }
+      else if (!strcmp (name, "-cache-meta"))
+        cache_meta_pct = atoi (value);
+      else if (!strcmp (name, "-extents"))
+        inode_use_extents (true);
+      else if (!strcmp (name, "-alloc"))
+        {
+          if (!strcmp (value, "near"))
+            free_map_set_locality (true);
+          else if (!strcmp (value, "first"))
+            free_map_set_locality (false);
+          else
+            PANIC ("unknown allocator `%s' (use -h for help)", value);
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -315,6 +363,7 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"frag", 1, fsutil_frag},
 #endif
       {NULL, 0, NULL},
     };
@@ -364,6 +413,7 @@ usage (void)
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
+          "  frag               Report fragmentation of files and free space.\n"
 #endif
           "\nOptions:\n"
           "  -h                 Print this help message and power off.\n"
@@ -373,6 +423,14 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -cache=N           Start with an N-sector buffer cache.\n"
+          "  -cache-max=N       Let the buffer cache grow to N sectors.\n"
+          "  -wb-interval=TICKS Write back dirty cache entries every TICKS.\n"
+          "  -wb-ratio=PCT      Write back early once PCT%% of the cache is dirty.\n"
+          "  -cache-policy=NAME Replace cache entries by NAME: clock, 2q or arc.\n"
+          "  -cache-meta=PCT    Reserve PCT%% of the buffer cache for metadata.\n"
+          "  -extents           Map new files with extents instead of by sector.\n"
+          "  -alloc=NAME        Place sectors by NAME: near (default) or first.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -27,8 +27,6 @@ void parsing(char* file_name, char** argvs);
 void construct_esp(char** argv, void** esp);
 
 
-struct lock filesys_lock;
-
     struct file *
 process_get_file(int fd)
 {
@@ -151,9 +149,7 @@ start_process (void *file_name_)
     if_.cs = SEL_UCSEG;
     if_.eflags = FLAG_IF | FLAG_MBS;
 
-    lock_acquire(&filesys_lock);
     success = load (file_name, &if_.eip, &if_.esp);
-    lock_release(&filesys_lock);
     palloc_free_page (file_name);
     sema_up(&thread_current()->parent->load_sem);
     if (success == NULL){
@@ -16,6 +16,8 @@
 #include "filesys/directory.h"
 #include "filesys/inode.h"
 #include "filesys/file.h"
+#include "filesys/cache.h"
+#include "filesys/free-map.h"
 
 static void syscall_handler (struct intr_frame *);
 void halt(void);
@@ -27,6 +29,7 @@ int fibonacci(int n);
 int max_of_four_int(int a, int b, int c, int d);
 void exit(int status);
 void addr_check(void *addr);
+void range_check(const void *addr, unsigned size);
 void get_argument(void *esp, void *args[], int count);
 
 bool create(const char* file, unsigned initial_size);
@@ -39,12 +42,13 @@ unsigned tell(int fd);
 //proj5
 int inumber(int fd);
 bool isdir(int fd);
+bool cachestat(int fd, struct cache_stat* stat);
+bool fsync(int fd);
+void sync(void);
 int readdir(int fd, char* name);
 int mkdir(char* dir);
 int chdir(char* path);
 
-struct lock filesys_lock;
-
 //proj5
 struct dir
 {
@@ -52,18 +56,10 @@ struct dir
     off_t pos;          
 };
 
-struct file 
-  {
-    struct inode *inode;        
-    off_t pos;                 
-    bool deny_write;          
-  };
-
 void
 syscall_init (void) 
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
-  lock_init(&filesys_lock);
 }
 
 static void
@@ -154,6 +150,17 @@ syscall_handler (struct intr_frame *f UNUSED)
         get_argument(f->esp, args, 1);
         f->eax = inumber ((int)*(uint32_t*)args[0]);
         break;
+    case SYS_CACHESTAT:
+        get_argument(f->esp, args, 2);
+        f->eax = cachestat ((int)*(uint32_t*)args[0], (struct cache_stat *)*(uint32_t*)args[1]);
+        break;
+    case SYS_FSYNC:
+        get_argument(f->esp, args, 1);
+        f->eax = fsync ((int)*(uint32_t*)args[0]);
+        break;
+    case SYS_SYNC:
+        sync ();
+        break;
 	default:
 		thread_exit();
   }
@@ -185,13 +192,11 @@ int wait(pid_t pid){
 
 int read(int fd, void* buffer, unsigned length)
 {
-	lock_acquire(&filesys_lock);
 	int fr = -1;
 	if(fd == 0){
 		for(unsigned i = 0; i < length; i++){
 			((char*)buffer)[i] = (char)input_getc();
 		}
-		lock_release(&filesys_lock);
 		return length;
 	}
 	addr_check(buffer);
@@ -200,20 +205,16 @@ int read(int fd, void* buffer, unsigned length)
 		fr = file_read(file, buffer, length);
 	}
     else{
-        lock_release(&filesys_lock);
         exit(-1);
     }
-	lock_release(&filesys_lock);
 	return fr;
 }
 
 int write(int fd, const void* buffer, unsigned length)
 {
-	lock_acquire(&filesys_lock);
 	int fw = -1;
 	if(fd == 1){
 		putbuf((char*)buffer, length);
-		lock_release(&filesys_lock);
 		return length;
 	}
 	struct file* file = process_get_file(fd);
@@ -221,10 +222,8 @@ int write(int fd, const void* buffer, unsigned length)
 		fw = file_write(file, buffer, length);
 	}
 	else{
-		lock_release(&filesys_lock);
 		exit(-1);
 	}
-	lock_release(&filesys_lock);
 	return fw;
 }
 
@@ -267,6 +266,18 @@ void addr_check(void *addr){
         exit(-1);
 }
 
+/* Exits unless all SIZE bytes from ADDR are mapped user memory. */
+void range_check(const void *addr, unsigned size){
+    const uint8_t *end = (const uint8_t*)addr + size;
+    if(size == 0)
+        return;
+    if(end < (const uint8_t*)addr || !is_user_vaddr(end - 1))
+        exit(-1);
+    for(const uint8_t *p = pg_round_down(addr); p < end; p += PGSIZE)
+        if(pagedir_get_page(thread_current()->pagedir, p) == NULL)
+            exit(-1);
+}
+
 void get_argument(void *esp, void *args[], int count)
 {
 	for(int i = 1; i <= count; i++){
@@ -282,10 +293,7 @@ bool create(const char* file, unsigned initial_size)
 	if(file == NULL)
 		exit(-1);
     addr_check((void*)file);
-	lock_acquire(&filesys_lock);	
-	bool fc = filesys_create(file, initial_size);
-	lock_release(&filesys_lock);
-	return fc;
+	return filesys_create(file, initial_size);
 }
 
 bool remove(const char* file)
@@ -293,10 +301,7 @@ bool remove(const char* file)
     if(file == NULL)
         exit(-1);
     addr_check((void*)file);
-	lock_acquire(&filesys_lock);
-	bool fr = filesys_remove(file);
-	lock_release(&filesys_lock);
-	return fr;
+	return filesys_remove(file);
 }
 
 int open(const char* file)
@@ -304,16 +309,12 @@ int open(const char* file)
 	if(file == NULL)
 		return -1;
     addr_check((void*)file);
-	lock_acquire(&filesys_lock);
 	struct file* fp = filesys_open(file);
-	if(fp == NULL){	
-		lock_release(&filesys_lock);
+	if(fp == NULL)
 		return -1;
-	}
 	if(strcmp(thread_current()->name, file) == 0)
 		file_deny_write(fp);
 
-	lock_release(&filesys_lock);
     if(fp == NULL)
         return -1;
     thread_current()->fd[++(thread_current()->fd_max)] = fp;
@@ -381,10 +382,47 @@ int readdir(int fd, char* name)
 
 bool isdir(int fd){
 	struct file* cur_file = thread_current()->fd[fd];
-	return inode_is_dir(cur_file->inode);
+	return inode_is_dir(file_get_inode(cur_file));
 }
 
 int inumber(int fd){
 	struct file* cur_file = thread_current()->fd[fd];
-	return inode_get_inumber(cur_file->inode);
+	return inode_get_inumber(file_get_inode(cur_file));
+}
+
+/* Copies buffer cache statistics to STAT: for the file open as
+   FD, or for the whole cache if FD is -1.  They are gathered into
+   a kernel copy first, so that a fault on STAT never happens with
+   the cache locked. */
+bool cachestat(int fd, struct cache_stat* stat){
+    struct cache_stat kstat;
+    struct file* cur_file;
+
+    range_check(stat, sizeof *stat);
+    if(fd == -1)
+        buffer_cache_stat(&kstat);
+    else if(fd < 0 || (cur_file = process_get_file(fd)) == NULL)
+        return false;
+    else if(buffer_cache_owner_stat(inode_get_inumber(file_get_inode(cur_file)), &kstat) == false)
+        return false;
+    memcpy(stat, &kstat, sizeof kstat);
+    return true;
+}
+
+/* Writes the data and metadata of the file open as FD to disk. */
+bool fsync(int fd){
+    struct file* cur_file;
+
+    if(fd < 0 || (cur_file = process_get_file(fd)) == NULL)
+        return false;
+    inode_sync(file_get_inode(cur_file));
+    return true;
+}
+
+/* Writes every change to open inodes and in the buffer cache to
+   disk. */
+void sync(void){
+    inode_flush_all();
+    free_map_sync();
+    buffer_cache_flush_all();
 }
\ No newline at end of file